@@ -0,0 +1,120 @@
+#include "Arena.hpp"
+
+#include <new>
+#include <utility>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+Arena::Arena()
+{
+	base = nullptr;
+	size = used = 0;
+	mapping = nullptr;
+	mappingSize = 0;
+	hugePages = false;
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+Arena::Arena(Arena &&_other)
+{
+	base = _other.base;
+	size = _other.size;
+	used = _other.used;
+	mapping = _other.mapping;
+	mappingSize = _other.mappingSize;
+	hugePages = _other.hugePages;
+	_other.base = _other.mapping = nullptr;
+	_other.size = _other.used = _other.mappingSize = 0;
+}
+
+Arena &Arena::operator=(Arena &&_other)
+{
+	if(this != &_other)
+	{
+		release();
+		std::swap(base, _other.base);
+		std::swap(size, _other.size);
+		std::swap(used, _other.used);
+		std::swap(mapping, _other.mapping);
+		std::swap(mappingSize, _other.mappingSize);
+		std::swap(hugePages, _other.hugePages);
+	}
+	return *this;
+}
+
+//Maps a zeroed block of at least _size bytes, dropping any block held before. Large blocks are mapped with room to spare,
+//so that they can start on a huge page boundary
+bool Arena::reserve(Uint64 _size)
+{
+	release();
+	if(_size == 0) { return true; }
+	size = footprint(_size);
+#ifdef _WIN32
+	//Large pages need a privilege most users do not have, so ordinary pages are used
+	mappingSize = size;
+	mapping = static_cast<Uint8 *>(VirtualAlloc(nullptr, mappingSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+	base = mapping;
+#else
+	bool huge = size >= HUGE_PAGE_SIZE;
+	if(huge) { size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE; }
+	mappingSize = huge ? size + HUGE_PAGE_SIZE : size;
+	void *mapped = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapped != MAP_FAILED)
+	{
+		mapping = static_cast<Uint8 *>(mapped);
+		base = huge ? mapping + (HUGE_PAGE_SIZE - reinterpret_cast<uintptr_t>(mapping) % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE : mapping;
+#ifdef MADV_HUGEPAGE
+		hugePages = huge && madvise(base, size, MADV_HUGEPAGE) == 0;
+#endif
+	}
+#endif
+	if(!mapping)
+	{
+		size = mappingSize = 0;
+		return false;
+	}
+	return true;
+}
+
+void Arena::release()
+{
+	//Sub-arenas do not own their memory, so only the arena that mapped it unmaps it
+	if(mapping)
+	{
+#ifdef _WIN32
+		VirtualFree(mapping, 0, MEM_RELEASE);
+#else
+		munmap(mapping, mappingSize);
+#endif
+	}
+	base = mapping = nullptr;
+	size = used = mappingSize = 0;
+	hugePages = false;
+}
+
+//Hands out the next _bytes of the block, starting on a cache line. Running out is treated like a failed new
+void *Arena::carve(Uint64 _bytes)
+{
+	Uint64 bytes = footprint(_bytes);
+	if(bytes > size - used) { throw std::bad_alloc(); }
+	void *result = base + used;
+	used += bytes;
+	return result;
+}
+
+//Carves a slice of this arena that hands out its own memory and can be reset without touching the rest
+Arena Arena::carveArena(Uint64 _size)
+{
+	Arena result;
+	result.size = footprint(_size);
+	result.base = static_cast<Uint8 *>(carve(result.size));
+	result.hugePages = hugePages;
+	return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "SDL.h"
+
+const Uint8 ARENA_ALIGNMENT = 64;
+const Uint32 HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+//One block of memory that buffers are carved out of in order, each starting on its own cache line. Memory is mapped straight
+//from the system and starts zeroed. On Linux it is aligned to and asks for transparent huge pages, so that a large grid needs
+//few TLB entries. A sub-arena is a slice of another arena that can be reset and carved again, for scratch space reused every tick
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+
+	static Uint64 footprint(Uint64 _bytes) { return (_bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT; };
+	template<typename T> static Uint64 footprint(Uint64 _count) { return footprint(_count * sizeof(T)); };
+
+	bool reserve(Uint64 _size);
+	void release();
+	void reset() { used = 0; };
+	void *carve(Uint64 _bytes);
+	template<typename T> T *carve(Uint64 _count) { return static_cast<T *>(carve(_count * sizeof(T))); };
+	Arena carveArena(Uint64 _size);
+
+	Uint64 getSize() const { return size; };
+	Uint64 getUsed() const { return used; };
+	bool usesHugePages() const { return hugePages; };
+
+	Arena(Arena &&_other);
+	Arena &operator=(Arena &&_other);
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+private:
+	Uint8 *base;
+	Uint64 size, used;
+	Uint8 *mapping;
+	Uint64 mappingSize;
+	bool hugePages;
+};
@@ -0,0 +1,250 @@
+#include "Simulation.hpp"
+#include "Recorder.hpp"
+#include "Snapshot.hpp"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//Runs the simulation without a window on a set of canned scenes and prints the results as json.
+//Every scene uses the same seed, so runs on different builds see the same workload and can be compared by checksum.
+//Each scene is run once per traversal order unless one is chosen, so both orders are compared on the same workload.
+const char *USAGE = "usage: benchmark [--ticks N] [--threads N] [--width N] [--height N] [--seed N] [--scene NAME] [--traversal NAME] "
+	"[--replay PATH] [--snapshot PATH]\n";
+
+const Uint32 DEFAULT_TICKS = 500;
+const Uint32 DEFAULT_WIDTH = 1150;
+const Uint32 DEFAULT_HEIGHT = 800;
+const Uint32 DEFAULT_SEED = 1;
+
+struct Scene
+{
+	const char *name;
+	void (*fill)(Simulation &_sim, Sint32 _w, Sint32 _h);
+};
+
+//A thick band of sand high up that collapses into a pile
+void fillAvalanche(Simulation &_sim, Sint32 _w, Sint32 _h)
+{
+	_sim.setCellLine({_w / 10, _h / 6}, {_w * 9 / 10, _h / 6}, _h / 8, _sim.findMaterial("Sand"));
+}
+
+//A rock basin that is filled by a falling body of water
+void fillBasin(Simulation &_sim, Sint32 _w, Sint32 _h)
+{
+	_sim.setCellLine({_w / 8, _h - 10}, {_w * 7 / 8, _h - 10}, 8, _sim.findMaterial("Rock"));
+	_sim.setCellLine({_w / 8, _h / 2}, {_w / 8, _h - 10}, 8, _sim.findMaterial("Rock"));
+	_sim.setCellLine({_w * 7 / 8, _h / 2}, {_w * 7 / 8, _h - 10}, 8, _sim.findMaterial("Rock"));
+	_sim.setCellLine({_w / 4, _h / 4}, {_w * 3 / 4, _h / 4}, _h / 10, _sim.findMaterial("Water"));
+}
+
+//Lava poured onto a pool of water, producing steam and gravel
+void fillReaction(Simulation &_sim, Sint32 _w, Sint32 _h)
+{
+	_sim.setCellLine({_w / 6, _h * 5 / 6}, {_w * 5 / 6, _h * 5 / 6}, _h / 10, _sim.findMaterial("Water"));
+	_sim.setCellLine({_w / 3, _h / 3}, {_w * 2 / 3, _h / 3}, _h / 12, _sim.findMaterial("Lava"));
+}
+
+//Rows of wood lit from below
+void fillBurning(Simulation &_sim, Sint32 _w, Sint32 _h)
+{
+	for(Sint32 y = _h / 4; y < _h - 20; y += _h / 8)
+	{
+		_sim.setCellLine({_w / 10, y}, {_w * 9 / 10, y}, 10, _sim.findMaterial("Wood"));
+	}
+	_sim.setCellLine({_w / 10, _h - 10}, {_w * 9 / 10, _h - 10}, 6, _sim.findMaterial("Fire"));
+}
+
+//Every cell filled with a liquid, which keeps every chunk awake
+void fillFull(Simulation &_sim, Sint32, Sint32)
+{
+	_sim.reset(_sim.findMaterial("Water"));
+}
+
+struct TraversalOption
+{
+	const char *name;
+	Simulation::Traversal traversal;
+};
+
+const TraversalOption TRAVERSALS[] = {
+	{"shuffled", Simulation::Traversal::SHUFFLED},
+	{"sweep", Simulation::Traversal::SWEEP}
+};
+
+const Scene SCENES[] = {
+	{"avalanche", fillAvalanche},
+	{"basin", fillBasin},
+	{"reaction", fillReaction},
+	{"burning", fillBurning},
+	{"full", fillFull}
+};
+
+double percentile(const std::vector<double> &_sorted, double _p)
+{
+	return _sorted[std::min<size_t>(_sorted.size() - 1, static_cast<size_t>(_p * _sorted.size()))];
+}
+
+long peakRssKb()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+//Runs a filled simulation and prints its results. A replay is fed its recorded input before each tick
+void runScene(const char *_name, const char *_traversal, Simulation *_sim, Uint32 _ticks, Recorder *_replay, bool _first)
+{
+	std::vector<double> tickMs(_ticks);
+	auto start = std::chrono::steady_clock::now();
+	for(Uint32 i = 0; i < _ticks; ++i)
+	{
+		auto tickStart = std::chrono::steady_clock::now();
+		if(_replay) { _replay->replayTick(_sim); }
+		_sim->update();
+		tickMs[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tickStart).count();
+	}
+	double totalSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double meanMs = totalSec * 1000.0 / _ticks;
+	std::sort(tickMs.begin(), tickMs.end());
+	printf("%s\n\t\t{\n\t\t\t\"name\": \"%s\",\n\t\t\t\"traversal\": \"%s\",\n\t\t\t\"cells_per_sec\": %.0f,\n",
+		_first ? "" : ",", _name, _traversal, static_cast<double>(_sim->getWidth()) * _sim->getHeight() * _ticks / totalSec);
+	printf("\t\t\t\"ms_per_tick\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+		meanMs, percentile(tickMs, 0.5), percentile(tickMs, 0.9), percentile(tickMs, 0.99), tickMs.back());
+	printf("\t\t\t\"peak_rss_kb\": %ld,\n", peakRssKb());
+	printf("\t\t\t\"checksum\": \"%016llx\"\n\t\t}", static_cast<unsigned long long>(_sim->getChecksum()));
+	fflush(stdout);
+}
+
+//Reads a whole argument as a base 10 number no larger than a Uint32, so that a typo is refused instead of read as zero
+bool parseNumber(const char *_text, Uint32 &_value)
+{
+	char *end = nullptr;
+	errno = 0;
+	unsigned long value = strtoul(_text, &end, 10);
+	if(end == _text || *end != '\0' || errno != 0 || _text[0] == '-' || value > SDL_MAX_UINT32) { return false; }
+	_value = static_cast<Uint32>(value);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	Uint32 ticks = DEFAULT_TICKS;
+	Uint32 threads = 1;
+	Uint32 width = DEFAULT_WIDTH;
+	Uint32 height = DEFAULT_HEIGHT;
+	Uint32 seed = DEFAULT_SEED;
+	std::string only;
+	std::string onlyTraversal;
+	std::string replayPath;
+	std::string snapshotPath;
+	for(int i = 1; i < argc; i += 2)
+	{
+		if(strcmp(argv[i], "--help") == 0)
+		{
+			printf("%s", USAGE);
+			return EXIT_SUCCESS;
+		}
+		if(i + 1 >= argc)
+		{
+			fprintf(stderr, "missing value for %s\n%s", argv[i], USAGE);
+			return EXIT_FAILURE;
+		}
+		bool valid = true;
+		if(strcmp(argv[i], "--ticks") == 0) { valid = parseNumber(argv[i + 1], ticks) && ticks > 0; }
+		else if(strcmp(argv[i], "--threads") == 0) { valid = parseNumber(argv[i + 1], threads); }
+		else if(strcmp(argv[i], "--width") == 0) { valid = parseNumber(argv[i + 1], width) && width > 0; }
+		else if(strcmp(argv[i], "--height") == 0) { valid = parseNumber(argv[i + 1], height) && height > 0; }
+		else if(strcmp(argv[i], "--seed") == 0) { valid = parseNumber(argv[i + 1], seed); }
+		else if(strcmp(argv[i], "--scene") == 0) { only = argv[i + 1]; }
+		else if(strcmp(argv[i], "--traversal") == 0) { onlyTraversal = argv[i + 1]; }
+		else if(strcmp(argv[i], "--replay") == 0) { replayPath = argv[i + 1]; }
+		else if(strcmp(argv[i], "--snapshot") == 0) { snapshotPath = argv[i + 1]; }
+		else
+		{
+			fprintf(stderr, "unknown option %s\n%s", argv[i], USAGE);
+			return EXIT_FAILURE;
+		}
+		if(!valid)
+		{
+			fprintf(stderr, "invalid value for %s: %s\n%s", argv[i], argv[i + 1], USAGE);
+			return EXIT_FAILURE;
+		}
+	}
+
+	//A replay brings its own size and seed, and runs for the given number of ticks past its last event
+	Recorder replay;
+	if(!replayPath.empty())
+	{
+		if(!replay.loadReplay(replayPath))
+		{
+			fprintf(stderr, "could not load replay %s\n", replayPath.c_str());
+			return EXIT_FAILURE;
+		}
+		width = replay.getWidth();
+		height = replay.getHeight();
+		seed = replay.getSeed();
+	}
+
+	//A snapshot is a saved world that is run from the tick it was saved on
+	Snapshot snapshot;
+	if(!snapshotPath.empty())
+	{
+		if(!snapshot.open(snapshotPath))
+		{
+			fprintf(stderr, "could not load snapshot %s\n", snapshotPath.c_str());
+			return EXIT_FAILURE;
+		}
+		width = snapshot.getWidth();
+		height = snapshot.getHeight();
+		seed = snapshot.getSeed();
+	}
+
+	printf("{\n\t\"ticks\": %u,\n\t\"threads\": %u,\n\t\"width\": %u,\n\t\"height\": %u,\n\t\"seed\": %u,\n\t\"scenes\": [",
+		ticks, threads, width, height, seed);
+	bool first = true;
+	for(const TraversalOption &order : TRAVERSALS)
+	{
+		if(!onlyTraversal.empty() && onlyTraversal != order.name) { continue; }
+
+		if(!replayPath.empty())
+		{
+			Simulation sim(width, height, SDL_PIXELFORMAT_ARGB8888, threads);
+			sim.setSeed(seed);
+			sim.setTraversal(order.traversal);
+			replay.rewind();
+			runScene("replay", order.name, &sim, replay.getLastTick() + ticks, &replay, first);
+			first = false;
+			continue;
+		}
+		if(!snapshotPath.empty())
+		{
+			Simulation sim(width, height, SDL_PIXELFORMAT_ARGB8888, threads);
+			snapshot.restore(&sim);
+			sim.setTraversal(order.traversal);
+			runScene("snapshot", order.name, &sim, ticks, nullptr, first);
+			first = false;
+			continue;
+		}
+		for(const Scene &scene : SCENES)
+		{
+			if(!only.empty() && only != scene.name) { continue; }
+
+			Simulation sim(width, height, SDL_PIXELFORMAT_ARGB8888, threads);
+			sim.setSeed(seed);
+			sim.setTraversal(order.traversal);
+			scene.fill(sim, width, height);
+			runScene(scene.name, order.name, &sim, ticks, nullptr, first);
+			first = false;
+		}
+	}
+	printf("\n\t]\n}\n");
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "GlyphAtlas.hpp"
+
+#include <algorithm>
+
+GlyphAtlas::GlyphAtlas(SDL_Renderer *_ren, bool &_success, TTF_Font *_font)
+{
+	ren = _ren;
+	tex = nullptr;
+	lineHeight = TTF_FontHeight(_font);
+
+	//Glyphs are rendered on their own first, then packed into rows that wrap at the atlas width
+	const int glyphCount = LAST_GLYPH - FIRST_GLYPH + 1;
+	SDL_Surface *glyphSurfs[glyphCount];
+	Sint32 x = 0, y = 0;
+	for(int i = 0; i < glyphCount; ++i)
+	{
+		glyphSurfs[i] = TTF_RenderGlyph_Solid(_font, FIRST_GLYPH + i, TEXT_COLOR);
+		int advance = 0;
+		TTF_GlyphMetrics(_font, FIRST_GLYPH + i, nullptr, nullptr, nullptr, nullptr, &advance);
+		advances[i] = advance;
+		glyphs[i] = {0, 0, 0, 0};
+		if(!glyphSurfs[i]) { continue; }
+		if(x + glyphSurfs[i]->w > GLYPH_ATLAS_WIDTH)
+		{
+			x = 0;
+			y += lineHeight;
+		}
+		glyphs[i] = {x, y, glyphSurfs[i]->w, glyphSurfs[i]->h};
+		x += glyphSurfs[i]->w;
+	}
+
+	SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + lineHeight, 32, PIXEL_FORMAT);
+	for(int i = 0; i < glyphCount; ++i)
+	{
+		if(!glyphSurfs[i]) { continue; }
+		if(surf) { SDL_BlitSurface(glyphSurfs[i], nullptr, surf, &glyphs[i]); }
+		SDL_FreeSurface(glyphSurfs[i]);
+	}
+	if(surf)
+	{
+		tex = SDL_CreateTextureFromSurface(ren, surf);
+		SDL_FreeSurface(surf);
+	}
+	_success = _success && tex;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+	if(tex) { SDL_DestroyTexture(tex); }
+}
+
+//Gives the size of the box a piece of text fills, where each newline starts another line
+void GlyphAtlas::measureText(const std::string &_text, Sint32 &_width, Sint32 &_height) const
+{
+	Sint32 lineWidth = 0;
+	_width = 0;
+	_height = _text.empty() ? 0 : lineHeight;
+	for(char c : _text)
+	{
+		if(c == '\n')
+		{
+			lineWidth = 0;
+			_height += lineHeight;
+			continue;
+		}
+		lineWidth += advances[getGlyph(c)];
+		_width = std::max(_width, lineWidth);
+	}
+}
+
+void GlyphAtlas::drawText(const std::string &_text, Sint32 _x, Sint32 _y) const
+{
+	SDL_Rect dest = {_x, _y, 0, 0};
+	for(char c : _text)
+	{
+		if(c == '\n')
+		{
+			dest.x = _x;
+			dest.y += lineHeight;
+			continue;
+		}
+		const SDL_Rect &glyph = glyphs[getGlyph(c)];
+		dest.w = glyph.w;
+		dest.h = glyph.h;
+		if(glyph.w > 0) { SDL_RenderCopy(ren, tex, &glyph, &dest); }
+		dest.x += advances[getGlyph(c)];
+	}
+}
+
+//Characters the atlas does not have are drawn as a question mark
+int GlyphAtlas::getGlyph(char _c) const
+{
+	return (_c < FIRST_GLYPH || _c > LAST_GLYPH ? '?' : _c) - FIRST_GLYPH;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "SDL.h"
+#include "SDL_ttf.h"
+#include "Texture.hpp"
+
+#include <string>
+
+const char FIRST_GLYPH = ' ';
+const char LAST_GLYPH = '~';
+const Sint32 GLYPH_ATLAS_WIDTH = 512;
+
+//Every printable ascii character of a font rendered once into a single texture. Text is drawn as one copy per character
+//out of that texture, which the renderer batches into a single draw, so changing text never creates a texture
+class GlyphAtlas
+{
+public:
+	GlyphAtlas(SDL_Renderer *_ren, bool &_success, TTF_Font *_font);
+	~GlyphAtlas();
+
+	Sint32 getLineHeight() const { return lineHeight; };
+	void measureText(const std::string &_text, Sint32 &_width, Sint32 &_height) const;
+	void drawText(const std::string &_text, Sint32 _x, Sint32 _y) const;
+
+private:
+	SDL_Renderer *ren;
+	SDL_Texture *tex;
+	Sint32 lineHeight;
+	SDL_Rect glyphs[LAST_GLYPH - FIRST_GLYPH + 1];
+	Sint32 advances[LAST_GLYPH - FIRST_GLYPH + 1];
+
+	int getGlyph(char _c) const;
+};
\ No newline at end of file
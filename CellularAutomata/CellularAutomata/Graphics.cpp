@@ -42,75 +42,3 @@ void Graphics::drawCircle(SDL_Renderer *_ren, const SDL_Point *_center, const SD
 		}
 	}
 }
-
-//A modified version of bresenham's line algorithm
-Uint16 Graphics::bresenhams(Sint32 _x1, Sint32 _y1, Sint32 _x2, Sint32 _y2, Sint32 *&_xOut, Sint32 *&_yOut, bool _fill)
-{
-	Sint32 dx = _x2 - _x1;
-	Sint32 dy = _y2 - _y1;
-	bool hor = abs(dx) >= abs(dy);
-	if(hor && dx < 0 || !hor && dy < 0)
-	{
-		Sint32 temp = _x1;
-		_x1 = _x2;
-		_x2 = temp;
-		temp = _y1;
-		_y1 = _y2;
-		_y2 = temp;
-		dx = -dx;
-		dy = -dy;
-	}
-
-	bool di = true;
-	Sint32 d1, d2, i0, i1, j0, j1;
-	if(hor)
-	{
-		d1 = dx;
-		d2 = dy;
-		i0 = _x1;
-		i1 = _x2;
-		j0 = _y1;
-		j1 = _y2;
-	}
-	else
-	{
-		d1 = dy;
-		d2 = dx;
-		i0 = _y1;
-		i1 = _y2;
-		j0 = _x1;
-		j1 = _x2;
-	}
-	if(d2 < 0)
-	{
-		di = false;
-		d2 = -d2;
-	}
-	Sint32 D = 2 * d2 - d1;
-	Sint32 j = j0;
-	Uint16 len = i1 - i0;
-	if(_fill) { len += abs(j1 - j0) - 1; }
-	_xOut = new Sint32[len];
-	_yOut = new Sint32[len];
-	Uint16 index = 0;
-	for(Sint32 i = i0; i < i1; ++i)
-	{
-		_xOut[index] = hor ? i : j;
-		_yOut[index] = hor ? j : i;
-
-		if(D > 0)
-		{
-			if(_fill && i != i1 - 1)
-			{
-				++index;
-				_xOut[index] = hor ? i + 1 : j;
-				_yOut[index] = hor ? j : i + 1;
-			}
-			j += di ? 1 : -1;
-			D -= 2 * d1;
-		}
-		D += 2 * d2;
-		++index;
-	}
-	return len;
-}
@@ -3,10 +3,17 @@
 #include "Simulation.hpp"
 #include "Graphics.hpp"
 #include "Texture.hpp"
+#include "GlyphAtlas.hpp"
+#include "Recorder.hpp"
+#include "World.hpp"
+#include "SimulationThread.hpp"
+#include "Profiler.hpp"
 
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <cstdlib>
+#include <cerrno>
 
 //#define DEBUG
 
@@ -18,12 +25,8 @@ make fire work down
 remove iostream from everywhere
 rename window
 remove debug
-switch from bool flags to temperature
-freezing
 improve button system and move from spaces to composite textures
 window icon
-save/load with .bin
-liquid pressure
 non polar chemical reactions
 */
 
@@ -31,18 +34,32 @@ const Uint32 SCREEN_WIDTH = 1500;
 const Uint32 SCREEN_HEIGHT = 800;
 const Uint32 SIMULATION_WIDTH = 1150;
 const Uint32 SIMULATION_HEIGHT = 800;
-const SDL_Rect SIMULATION_RECT = {0, 0, SIMULATION_WIDTH, SIMULATION_HEIGHT};
 
-const Uint32 TICKS_PER_FRAME = 30;
-const Uint32 PERFORMANCE_POLL_RATE = 15;
+//Each cell covers a square of CELL_SCALE by CELL_SCALE screen pixels unless --scale is given, so a large window can trade
+//resolution for tick rate. The simulation area keeps its size on screen, and the grid shrinks to fit it
+const Uint8 CELL_SCALE = 1;
+const Uint8 MAX_CELL_SCALE = 8;
+
+//The map is a grid of regions much larger than the simulation, which is scrolled over it with the arrow keys
+const Uint16 WORLD_REGIONS_WIDE = 32;
+const Uint16 WORLD_REGIONS_HIGH = 16;
+const Sint32 SCROLL_STEP = 64;
+
+//The simulation ticks at a fixed rate on its own thread, while the screen is redrawn at a faster one
+const Uint32 TICK_INTERVAL = 30;
+const Uint32 FRAME_INTERVAL = 16;
 
 const std::string FONT_FILE_PATH = "../../Fipps-Regular.ttf";
+const std::string SNAPSHOT_FILE_PATH = "world.bin";
+const std::string REGION_DIRECTORY = "regions";
 
 const Uint16 MIN_DRAW_RADIUS = 3;
 const Uint16 MAX_DRAW_RADIUS = 75;
+const std::string BRUSH_NAMES[] = {"round", "square", "spray"};
 
 const Sint32 UI_HORIZONTAL_MARGIN = 20;
-const Sint32 UI_VERTICAL_MARGIN[] = {0, 12, 80, 160};
+//F3 shows the profiler's numbers for the last tick and frame under the material buttons
+const Sint32 UI_VERTICAL_MARGIN[] = {0, 12, 80, 160, 420};
 
 const SDL_Color CURSOR_COLOR = {255, 255, 255, 255};
 const SDL_Color UI_PANEL_COLOR = {80, 80, 80, 255};
@@ -52,6 +69,7 @@ enum class TextureID : Uint8 {
 	INFO_UI_TEXTURE,
 	TOOLS_UI_TEXTURE,
 	MATERIALS_UI_TEXTURE,
+	PROFILER_UI_TEXTURE,
 	TOTAL_TEXTURES
 };
 
@@ -64,7 +82,7 @@ enum class ToolButton : Uint8 {
 
 //Free all sdl resources
 void SDL_Cleanup(std::string _error, SDL_Window *_win = nullptr, SDL_Renderer *_ren = nullptr, 
-	TTF_Font *_font = nullptr, Texture *_tex[] = nullptr)
+	TTF_Font *_font = nullptr, GlyphAtlas *_atlas = nullptr, Texture *_tex[] = nullptr)
 {
 	if(!_error.empty())
 	{
@@ -75,12 +93,24 @@ void SDL_Cleanup(std::string _error, SDL_Window *_win = nullptr, SDL_Renderer *_
 	if(_win) { SDL_DestroyWindow(_win); }
 	if(_ren) { SDL_DestroyRenderer(_ren); }
 	if(_font) { TTF_CloseFont(_font); }
+	if(_atlas) { delete _atlas; }
 	if(_tex) { for(int i = 0; i < static_cast<int>(TextureID::TOTAL_TEXTURES); ++i) { if(_tex[i]) { delete _tex[i]; } } }
 	
 	TTF_Quit();
 	SDL_Quit();
 }
 
+//Reads a whole argument as a base 10 number no larger than a Uint32, so that a typo is refused instead of read as zero
+bool parseNumber(const char *_text, Uint32 &_value)
+{
+	char *end = nullptr;
+	errno = 0;
+	unsigned long value = strtoul(_text, &end, 10);
+	if(end == _text || *end != '\0' || errno != 0 || _text[0] == '-' || value > SDL_MAX_UINT32) { return false; }
+	_value = static_cast<Uint32>(value);
+	return true;
+}
+
 int main(int argc, char **argv)
 {
 	//Create all SDL resources, terminating the program if any fail to create
@@ -103,6 +133,8 @@ int main(int argc, char **argv)
 		SDL_Cleanup("renderer creation", win);
 		return EXIT_FAILURE;
 	}
+	//Scaled cells are stretched by the renderer, and have to stay hard edged squares rather than be blurred together
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
 
 	TTF_Init();
 	TTF_Font *font = TTF_OpenFont(FONT_FILE_PATH.c_str(), 16);
@@ -111,22 +143,77 @@ int main(int argc, char **argv)
 		SDL_Cleanup("font creation", win, ren);
 		return EXIT_FAILURE;
 	}
+	//Every piece of text is drawn out of one atlas, so changing it on every frame costs no texture creation
+	bool success = true;
+	GlyphAtlas *atlas = new GlyphAtlas(ren, success, font);
+	if(!success)
+	{
+		SDL_Cleanup("glyph atlas creation", win, ren, font, atlas);
+		return EXIT_FAILURE;
+	}
 
-	Simulation sim(SIMULATION_WIDTH, SIMULATION_HEIGHT, PIXEL_FORMAT);
+	//--seed N makes the session reproducible, --record PATH logs the input so it can be replayed headless,
+	//--profile PATH writes the profiler's numbers for every tick to a csv or json lines file,
+	//and --scale N draws every cell as an N by N square of pixels
+	bool hasSeed = false;
+	Uint32 seed = 0;
+	std::string recordPath;
+	std::string profilePath;
+	Uint8 scale = CELL_SCALE;
+	for(int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if(arg == "--record") { recordPath = argv[i + 1]; }
+		else if(arg == "--profile") { profilePath = argv[i + 1]; }
+		else if(arg == "--seed" || arg == "--scale")
+		{
+			Uint32 value = 0;
+			if(!parseNumber(argv[i + 1], value))
+			{
+				std::string usage = "invalid value for " + arg + ": " + argv[i + 1] +
+					"\nusage: --seed N --scale N --record PATH --profile PATH, where N is a whole number";
+				std::cerr << usage << std::endl;
+				SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Invalid argument", usage.c_str(), win);
+				SDL_Cleanup(std::string(), win, ren, font, atlas);
+				return EXIT_FAILURE;
+			}
+			if(arg == "--seed")
+			{
+				seed = value;
+				hasSeed = true;
+			}
+			else { scale = static_cast<Uint8>(std::clamp<Uint32>(value, 1, MAX_CELL_SCALE)); }
+		}
+	}
+	Simulation sim(SIMULATION_WIDTH / scale, SIMULATION_HEIGHT / scale, PIXEL_FORMAT, SDL_GetCPUCount());
+	if(hasSeed) { sim.setSeed(seed); }
+	const SDL_Rect simulationRect = {0, 0, sim.getWidth() * scale, sim.getHeight() * scale};
+	Recorder recorder;
+	if(!recordPath.empty() && !recorder.startRecording(recordPath, &sim))
+	{
+		SDL_Cleanup("recording", win, ren, font, atlas);
+		return EXIT_FAILURE;
+	}
+	World world(&sim, WORLD_REGIONS_WIDE, WORLD_REGIONS_HIGH, REGION_DIRECTORY);
+	std::vector<std::string> materialNames;
+	for(int i = 0; i < MAX_MATERIALS; ++i) { materialNames.push_back(sim.getMaterialName(static_cast<Simulation::Material>(i))); }
+	Profiler profiler(materialNames, profilePath);
+	sim.setProfiler(&profiler);
 
 	Texture *tex[static_cast<int>(TextureID::TOTAL_TEXTURES)];
-	bool success = true;
-	tex[static_cast<int>(TextureID::SIMULATION_TEXTURE)] = new Texture(ren, success, SIMULATION_RECT);
-	tex[static_cast<int>(TextureID::INFO_UI_TEXTURE)] = new Texture(ren, SIMULATION_WIDTH + UI_HORIZONTAL_MARGIN, UI_VERTICAL_MARGIN[static_cast<int>(TextureID::INFO_UI_TEXTURE)], font);
+	tex[static_cast<int>(TextureID::SIMULATION_TEXTURE)] = new Texture(ren, success, simulationRect, scale);
+	tex[static_cast<int>(TextureID::INFO_UI_TEXTURE)] = new Texture(ren, SIMULATION_WIDTH + UI_HORIZONTAL_MARGIN, UI_VERTICAL_MARGIN[static_cast<int>(TextureID::INFO_UI_TEXTURE)], atlas);
 	SDL_Rect rect = {SIMULATION_WIDTH + UI_HORIZONTAL_MARGIN, UI_VERTICAL_MARGIN[static_cast<int>(TextureID::TOOLS_UI_TEXTURE)], SCREEN_WIDTH - SIMULATION_WIDTH - UI_HORIZONTAL_MARGIN * 2, 0};
-	tex[static_cast<int>(TextureID::TOOLS_UI_TEXTURE)] = new Texture(ren, success, rect, font, "Pause Erase Reset ");
+	tex[static_cast<int>(TextureID::TOOLS_UI_TEXTURE)] = new Texture(ren, success, rect, atlas, "Pause Erase Reset ");
 	rect.y = UI_VERTICAL_MARGIN[static_cast<int>(TextureID::MATERIALS_UI_TEXTURE)];
-	tex[static_cast<int>(TextureID::MATERIALS_UI_TEXTURE)] = new Texture(ren, success, rect, font, sim.getMaterialString());
+	tex[static_cast<int>(TextureID::MATERIALS_UI_TEXTURE)] = new Texture(ren, success, rect, atlas, sim.getMaterialString());
+	tex[static_cast<int>(TextureID::PROFILER_UI_TEXTURE)] = new Texture(ren, SIMULATION_WIDTH + UI_HORIZONTAL_MARGIN, UI_VERTICAL_MARGIN[static_cast<int>(TextureID::PROFILER_UI_TEXTURE)], atlas);
 	if(!success)
 	{
-		SDL_Cleanup("texture creation", win, ren, font, tex);
+		SDL_Cleanup("texture creation", win, ren, font, atlas, tex);
 		return EXIT_FAILURE;
 	}
+	SimulationThread simThread(&sim, &world, recordPath.empty() ? nullptr : &recorder, TICK_INTERVAL, SNAPSHOT_FILE_PATH);
 	
 	//Main loop
 	SDL_Event e;
@@ -134,17 +221,18 @@ int main(int argc, char **argv)
 	SDL_Point lastCursor = cursor;
 	Uint32 lastTick = 0;
 	Uint32 lastRenderTime = 0;
-	Simulation::Material material = Simulation::Material::SAND;
+	//Sand is picked to start with, or the first material in the file when there is no sand
+	Simulation::Material material = sim.findMaterial("Sand");
+	if(material == Simulation::Material::NO_MATERIAL) { material = static_cast<Simulation::Material>(1); }
 	Uint16 drawRadius = 15;
-	bool drawRadChanged;
+	Simulation::Brush brush = Simulation::Brush::ROUND;
 	bool lmbPressed;
 	bool lmbHeld = false;
-	bool paused = false;
+	bool showProfiler = false;
 	bool quit = false;
 	while(!quit)
 	{
 		lmbPressed = false;
-		drawRadChanged = false;
 		//User input
 		while(SDL_PollEvent(&e))
 		{
@@ -162,7 +250,43 @@ int main(int argc, char **argv)
 					break;
 				
 				case SDLK_SPACE:
-					paused = !paused;
+					simThread.setPaused(!simThread.isPaused());
+					break;
+
+				case SDLK_LEFT:
+					simThread.pushCommand({SimulationThread::CommandType::SCROLL, material, 0, {-SCROLL_STEP, 0}, {0, 0}});
+					break;
+
+				case SDLK_RIGHT:
+					simThread.pushCommand({SimulationThread::CommandType::SCROLL, material, 0, {SCROLL_STEP, 0}, {0, 0}});
+					break;
+
+				case SDLK_UP:
+					simThread.pushCommand({SimulationThread::CommandType::SCROLL, material, 0, {0, -SCROLL_STEP}, {0, 0}});
+					break;
+
+				case SDLK_DOWN:
+					simThread.pushCommand({SimulationThread::CommandType::SCROLL, material, 0, {0, SCROLL_STEP}, {0, 0}});
+					break;
+
+				//F5 saves the world and F9 restores the last save
+				case SDLK_F5:
+					simThread.pushCommand({SimulationThread::CommandType::SAVE, material, 0, {0, 0}, {0, 0}});
+					break;
+
+				case SDLK_F9:
+					simThread.pushCommand({SimulationThread::CommandType::LOAD, material, 0, {0, 0}, {0, 0}});
+					break;
+
+				//Timing costs a little, so the profiler only runs while its numbers are shown or written to a file
+				case SDLK_F3:
+					showProfiler = !showProfiler;
+					profiler.setEnabled(showProfiler);
+					break;
+
+				//B cycles through the brush shapes
+				case SDLK_b:
+					brush = static_cast<Simulation::Brush>((static_cast<int>(brush) + 1) % static_cast<int>(Simulation::Brush::TOTAL_BRUSHES));
 					break;
 				}
 				break;
@@ -183,15 +307,21 @@ int main(int argc, char **argv)
 
 			case SDL_MOUSEWHEEL:
 				drawRadius = std::clamp<Sint16>(drawRadius + e.wheel.y, MIN_DRAW_RADIUS, MAX_DRAW_RADIUS);
-				drawRadChanged = true;
 				break;
 			}
 		}
 
-		if(SDL_PointInRect(&cursor, &SIMULATION_RECT))
+		if(SDL_PointInRect(&cursor, &simulationRect))
 		{
 			SDL_ShowCursor(SDL_DISABLE);
-			if(lmbHeld) { sim.setCellLine(cursor, lastCursor, drawRadius, material); }
+			if(lmbHeld)
+			{
+				//The brush is sized in screen pixels, so the circle around the cursor always matches what is drawn
+				SDL_Point cell = {cursor.x / scale, cursor.y / scale};
+				SDL_Point lastCell = {lastCursor.x / scale, lastCursor.y / scale};
+				Uint16 cellRadius = std::max(drawRadius / scale, 1);
+				simThread.pushCommand({SimulationThread::CommandType::STROKE, material, cellRadius, cell, lastCell, brush});
+			}
 		}
 		else
 		{
@@ -204,7 +334,7 @@ int main(int argc, char **argv)
 					switch(static_cast<ToolButton>(clicked))
 					{
 					case ToolButton::PAUSE:
-						paused = !paused;
+						simThread.setPaused(!simThread.isPaused());
 						break;
 
 					case ToolButton::ERASE:
@@ -212,7 +342,7 @@ int main(int argc, char **argv)
 						break;
 
 					case ToolButton::RESET:
-						sim.reset();
+						simThread.pushCommand({SimulationThread::CommandType::RESET, Simulation::Material::EMPTY, 0, {0, 0}, {0, 0}});
 						break;
 					}
 				}
@@ -223,24 +353,44 @@ int main(int argc, char **argv)
 			}
 		}
 
-		if(!paused) { sim.update(); }
-
 		//Draw to the screen
 		Graphics::setRenderColor(ren, &UI_PANEL_COLOR);
 		SDL_RenderClear(ren);
 
-		if(SDL_GetTicks() % PERFORMANCE_POLL_RATE == 0 || drawRadChanged)
 		{
-			std::string text = std::to_string(std::min(1000 / std::max<Uint32>(lastRenderTime, 1), 1000 / TICKS_PER_FRAME)) + "fps       pen size: " + std::to_string(drawRadius * 2);
+			Profiler::ScopedTimer timer(&profiler, Profiler::Timer::UI_TEXT);
+			std::string text = std::to_string(std::min(1000 / std::max<Uint32>(lastRenderTime, 1), 1000 / FRAME_INTERVAL)) + "fps  " +
+				std::to_string(simThread.getTicksPerSecond()) + "tps  pen size: " + std::to_string(drawRadius * 2) + ' ' + BRUSH_NAMES[static_cast<int>(brush)];
 			tex[static_cast<int>(TextureID::INFO_UI_TEXTURE)]->changeText(text);
+			text.clear();
+			if(showProfiler) { for(const std::string &line : profiler.getSummary()) { text += line + '\n'; } }
+			tex[static_cast<int>(TextureID::PROFILER_UI_TEXTURE)]->changeText(text);
+		}
+		//Only the areas that changed since the last frame picked up are expanded from cells into the texture
+		if(const SimulationThread::Frame *frame = simThread.acquireFrame())
+		{
+			Profiler::ScopedTimer timer(&profiler, Profiler::Timer::TEXTURE_UPLOAD);
+			for(const SDL_Rect &region : frame->regions)
+			{
+				Uint32 *pixels;
+				int pitch;
+				if(tex[static_cast<int>(TextureID::SIMULATION_TEXTURE)]->lockTexture(&region, pixels, pitch))
+				{
+					sim.renderCells(&region, frame->cells + region.y * sim.getWidth() + region.x, sim.getWidth(), pixels, pitch);
+					tex[static_cast<int>(TextureID::SIMULATION_TEXTURE)]->unlockTexture();
+				}
+			}
 		}
-		tex[static_cast<int>(TextureID::SIMULATION_TEXTURE)]->changeTexture(sim.getDrawBuffer(), SIMULATION_WIDTH);
 		for(int i = 0; i < static_cast<int>(TextureID::TOTAL_TEXTURES); ++i) { tex[i]->renderTexture(); }
 
 		Graphics::setRenderColor(ren, &CURSOR_COLOR);
-		Graphics::drawCircle(ren, &cursor, &SIMULATION_RECT, drawRadius);
+		Graphics::drawCircle(ren, &cursor, &simulationRect, drawRadius);
 
-		SDL_RenderPresent(ren);
+		{
+			Profiler::ScopedTimer timer(&profiler, Profiler::Timer::PRESENT);
+			SDL_RenderPresent(ren);
+		}
+		profiler.endFrame();
 
 		lastCursor = cursor;
 
@@ -249,17 +399,17 @@ int main(int argc, char **argv)
 #ifdef DEBUG
 		std::cout << renderTime << "ms" << std::endl;
 #endif
-		SDL_Delay(TICKS_PER_FRAME - std::min(renderTime, TICKS_PER_FRAME));
+		SDL_Delay(FRAME_INTERVAL - std::min(renderTime, FRAME_INTERVAL));
 		lastRenderTime = renderTime;
 		lastTick = SDL_GetTicks();
 
 		if(strlen(SDL_GetError()) > 0)
 		{ 
-			SDL_Cleanup("runtime", win, ren, font, tex);
+			SDL_Cleanup("runtime", win, ren, font, atlas, tex);
 			return EXIT_FAILURE;
 		}
 	}
 
-	SDL_Cleanup(std::string(), win, ren, font, tex);
+	SDL_Cleanup(std::string(), win, ren, font, atlas, tex);
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
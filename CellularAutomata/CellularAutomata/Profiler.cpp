@@ -0,0 +1,127 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+const char *Profiler::TIMER_NAMES[static_cast<int>(Timer::TOTAL_TIMERS)] = {
+	"tick", "random_fill", "cell_update", "cell_update_reactions", "pressure", "heat", "texture_upload", "ui_text", "present"
+};
+
+const char *Profiler::COUNTER_NAMES[static_cast<int>(Counter::TOTAL_COUNTERS)] = {
+	"cells_visited", "cells_skipped", "cells_moved", "reactions"
+};
+
+//Timers up to this one belong to a tick, and the rest to a frame
+const Profiler::Timer LAST_TICK_TIMER = Profiler::Timer::HEAT;
+
+Profiler::ScopedTimer::ScopedTimer(Profiler *_profiler, Timer _timer)
+{
+	profiler = _profiler && _profiler->isEnabled() ? _profiler : nullptr;
+	timer = _timer;
+	if(profiler) { start = std::chrono::steady_clock::now(); }
+}
+
+void Profiler::ScopedTimer::stop()
+{
+	if(!profiler) { return; }
+	profiler->addTime(timer, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	profiler = nullptr;
+}
+
+Profiler::Profiler(const std::vector<std::string> &_materialNames, const std::string &_path)
+{
+	materialNames = _materialNames;
+	materialCount = static_cast<Uint8>(materialNames.size());
+	reactions = new std::atomic<Uint32>[materialCount * materialCount];
+	for(int i = 0; i < materialCount * materialCount; ++i) { reactions[i] = 0; }
+	lastReactions.assign(materialCount * materialCount, 0);
+	for(int i = 0; i < static_cast<int>(Timer::TOTAL_TIMERS); ++i) { times[i] = lastTimes[i] = 0; }
+	for(int i = 0; i < static_cast<int>(Counter::TOTAL_COUNTERS); ++i) { counts[i] = lastCounts[i] = 0; }
+	lastTick = 0;
+
+	csv = _path.size() >= 4 && _path.compare(_path.size() - 4, 4, ".csv") == 0;
+	if(!_path.empty()) { file.open(_path, std::ios::trunc); }
+	if(file.is_open() && csv)
+	{
+		file << "tick";
+		for(const char *name : TIMER_NAMES) { file << ',' << name << "_us"; }
+		for(const char *name : COUNTER_NAMES) { file << ',' << name; }
+		file << '\n';
+	}
+	enabled = file.is_open();
+}
+
+Profiler::~Profiler()
+{
+	delete[] reactions;
+}
+
+void Profiler::addReaction(Uint8 _self, Uint8 _other)
+{
+	++reactions[_self * materialCount + _other];
+	++counts[static_cast<int>(Counter::REACTIONS)];
+}
+
+//Moves the running tick totals into the last tick and writes them out as a row, along with the last frame's timers
+void Profiler::endTick(Uint32 _tick)
+{
+	if(!enabled) { return; }
+	std::lock_guard<std::mutex> lock(lastMutex);
+	lastTick = _tick;
+	for(int i = 0; i <= static_cast<int>(LAST_TICK_TIMER); ++i) { lastTimes[i] = times[i].exchange(0); }
+	for(int i = 0; i < static_cast<int>(Counter::TOTAL_COUNTERS); ++i) { lastCounts[i] = counts[i].exchange(0); }
+	for(int i = 0; i < materialCount * materialCount; ++i) { lastReactions[i] = reactions[i].exchange(0); }
+	if(!file.is_open()) { return; }
+
+	if(csv)
+	{
+		file << lastTick;
+		for(Uint64 time : lastTimes) { file << ',' << time / 1000; }
+		for(Uint32 count : lastCounts) { file << ',' << count; }
+		file << '\n';
+		return;
+	}
+	file << "{\"tick\": " << lastTick << ", \"us\": {";
+	for(int i = 0; i < static_cast<int>(Timer::TOTAL_TIMERS); ++i) { file << (i ? ", \"" : "\"") << TIMER_NAMES[i] << "\": " << lastTimes[i] / 1000; }
+	file << "}, \"counts\": {";
+	for(int i = 0; i < static_cast<int>(Counter::TOTAL_COUNTERS); ++i) { file << (i ? ", \"" : "\"") << COUNTER_NAMES[i] << "\": " << lastCounts[i]; }
+	file << "}, \"reactions\": {";
+	bool first = true;
+	for(int i = 0; i < materialCount * materialCount; ++i)
+	{
+		if(lastReactions[i] == 0) { continue; }
+		file << (first ? "\"" : ", \"") << materialNames[i / materialCount] << '>' << materialNames[i % materialCount] << "\": " << lastReactions[i];
+		first = false;
+	}
+	file << "}}\n";
+}
+
+void Profiler::endFrame()
+{
+	if(!enabled) { return; }
+	std::lock_guard<std::mutex> lock(lastMutex);
+	for(int i = static_cast<int>(LAST_TICK_TIMER) + 1; i < static_cast<int>(Timer::TOTAL_TIMERS); ++i) { lastTimes[i] = times[i].exchange(0); }
+}
+
+//One short line per timer and counter, followed by the most common reactions of the last tick, for the overlay
+std::vector<std::string> Profiler::getSummary()
+{
+	std::lock_guard<std::mutex> lock(lastMutex);
+	std::vector<std::string> lines;
+	for(int i = 0; i < static_cast<int>(Timer::TOTAL_TIMERS); ++i)
+	{
+		char buffer[48];
+		snprintf(buffer, sizeof(buffer), "%s %.2fms", TIMER_NAMES[i], lastTimes[i] / 1000000.0);
+		lines.push_back(buffer);
+	}
+	for(int i = 0; i < static_cast<int>(Counter::TOTAL_COUNTERS); ++i) { lines.push_back(std::string(COUNTER_NAMES[i]) + ' ' + std::to_string(lastCounts[i])); }
+
+	std::vector<int> order;
+	for(int i = 0; i < materialCount * materialCount; ++i) { if(lastReactions[i] > 0) { order.push_back(i); } }
+	std::sort(order.begin(), order.end(), [&](int _a, int _b) { return lastReactions[_a] > lastReactions[_b]; });
+	for(int i = 0; i < std::min<int>(order.size(), PROFILER_TOP_REACTIONS); ++i)
+	{
+		lines.push_back(materialNames[order[i] / materialCount] + '>' + materialNames[order[i] % materialCount] + ' ' + std::to_string(lastReactions[order[i]]));
+	}
+	return lines;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "SDL.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+const Uint8 PROFILER_TOP_REACTIONS = 3;
+
+//Times the phases of every tick and frame and counts what the simulation did on each tick.
+//Nothing is measured while it is disabled. When a path is given, every tick is written to it as a row,
+//as csv when the path ends in .csv and as one json object per line otherwise
+class Profiler
+{
+public:
+	enum class Timer : Uint8
+	{
+		TICK = 0,
+		RANDOM_FILL,
+		CELL_UPDATE,
+		//Runs inside CELL_UPDATE, so its time is part of that timer too and is named as such in the output
+		REACTIONS,
+		PRESSURE,
+		HEAT,
+		TEXTURE_UPLOAD,
+		UI_TEXT,
+		PRESENT,
+		TOTAL_TIMERS
+	};
+
+	enum class Counter : Uint8
+	{
+		CELLS_VISITED = 0,
+		CELLS_SKIPPED,
+		CELLS_MOVED,
+		REACTIONS,
+		TOTAL_COUNTERS
+	};
+
+	//Adds the time between its construction and destruction, or an earlier stop, to a timer. A null or disabled profiler is never timed
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(Profiler *_profiler, Timer _timer);
+		~ScopedTimer() { stop(); };
+
+		void stop();
+
+	private:
+		Profiler *profiler;
+		Timer timer;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	Profiler(const std::vector<std::string> &_materialNames, const std::string &_path = std::string());
+	~Profiler();
+
+	void setEnabled(bool _enabled) { enabled = _enabled || file.is_open(); };
+	bool isEnabled() const { return enabled; };
+
+	void addTime(Timer _timer, Uint64 _nanoseconds) { times[static_cast<int>(_timer)] += _nanoseconds; };
+	void addCount(Counter _counter, Uint32 _count) { counts[static_cast<int>(_counter)] += _count; };
+	void addReaction(Uint8 _self, Uint8 _other);
+	void endTick(Uint32 _tick);
+	void endFrame();
+
+	std::vector<std::string> getSummary();
+
+private:
+	std::vector<std::string> materialNames;
+	Uint8 materialCount;
+	std::atomic<bool> enabled;
+	std::ofstream file;
+	bool csv;
+
+	//Running totals are added to from any thread. They are moved into the last tick or frame once it ends
+	std::atomic<Uint64> times[static_cast<int>(Timer::TOTAL_TIMERS)];
+	std::atomic<Uint32> counts[static_cast<int>(Counter::TOTAL_COUNTERS)];
+	std::atomic<Uint32> *reactions;
+
+	std::mutex lastMutex;
+	Uint32 lastTick;
+	Uint64 lastTimes[static_cast<int>(Timer::TOTAL_TIMERS)];
+	Uint32 lastCounts[static_cast<int>(Counter::TOTAL_COUNTERS)];
+	std::vector<Uint32> lastReactions;
+
+	static const char *TIMER_NAMES[static_cast<int>(Timer::TOTAL_TIMERS)];
+	static const char *COUNTER_NAMES[static_cast<int>(Counter::TOTAL_COUNTERS)];
+};
\ No newline at end of file
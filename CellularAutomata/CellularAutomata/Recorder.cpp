@@ -0,0 +1,121 @@
+#include "Recorder.hpp"
+
+//Events are stored as fixed 17 byte little endian records after a 14 byte header
+const Uint8 EVENT_SIZE = 17;
+
+Recorder::Recorder()
+{
+	width = 0;
+	height = 0;
+	seed = 0;
+	replayPosition = 0;
+}
+
+Recorder::~Recorder()
+{
+	if(file.is_open()) { file.close(); }
+}
+
+bool Recorder::startRecording(const std::string &_path, const Simulation *_sim)
+{
+	width = _sim->getWidth();
+	height = _sim->getHeight();
+	seed = _sim->getSeed();
+
+	file.open(_path, std::ios::binary | std::ios::trunc);
+	if(!file.is_open()) { return false; }
+	file.write(reinterpret_cast<const char *>(&RECORDING_MAGIC), sizeof(Uint32));
+	file.write(reinterpret_cast<const char *>(&RECORDING_VERSION), sizeof(Uint16));
+	file.write(reinterpret_cast<const char *>(&width), sizeof(Uint16));
+	file.write(reinterpret_cast<const char *>(&height), sizeof(Uint16));
+	file.write(reinterpret_cast<const char *>(&seed), sizeof(Uint32));
+	return file.good();
+}
+
+bool Recorder::loadReplay(const std::string &_path)
+{
+	std::ifstream in(_path, std::ios::binary);
+	Uint32 magic = 0;
+	Uint16 version = 0;
+	in.read(reinterpret_cast<char *>(&magic), sizeof(Uint32));
+	in.read(reinterpret_cast<char *>(&version), sizeof(Uint16));
+	in.read(reinterpret_cast<char *>(&width), sizeof(Uint16));
+	in.read(reinterpret_cast<char *>(&height), sizeof(Uint16));
+	in.read(reinterpret_cast<char *>(&seed), sizeof(Uint32));
+	if(!in.good() || magic != RECORDING_MAGIC || version != RECORDING_VERSION) { return false; }
+
+	events.clear();
+	replayPosition = 0;
+	char buffer[EVENT_SIZE];
+	while(in.read(buffer, EVENT_SIZE))
+	{
+		Event event;
+		memcpy(&event.tick, buffer, sizeof(Uint32));
+		event.type = static_cast<EventType>(buffer[4]);
+		event.material = static_cast<Simulation::Material>(buffer[5]);
+		memcpy(&event.radius, buffer + 6, sizeof(Uint16));
+		memcpy(&event.startX, buffer + 8, sizeof(Sint16));
+		memcpy(&event.startY, buffer + 10, sizeof(Sint16));
+		memcpy(&event.endX, buffer + 12, sizeof(Sint16));
+		memcpy(&event.endY, buffer + 14, sizeof(Sint16));
+		event.brush = static_cast<Simulation::Brush>(buffer[16]);
+		//Materials are numbered below the wall, so a larger number can only come from a damaged file
+		if(static_cast<Uint8>(event.type) > static_cast<Uint8>(EventType::RESET) || event.brush >= Simulation::Brush::TOTAL_BRUSHES ||
+			static_cast<Uint8>(event.material) >= static_cast<Uint8>(Simulation::Material::WALL))
+		{
+			events.clear();
+			return false;
+		}
+		events.push_back(event);
+	}
+	return true;
+}
+
+void Recorder::recordStroke(const Simulation *_sim, SDL_Point _start, SDL_Point _end, Uint16 _rad, Simulation::Material _mat, Simulation::Brush _brush)
+{
+	Event event = {_sim->getTick(), EventType::STROKE, _mat, _rad,
+		static_cast<Sint16>(_start.x), static_cast<Sint16>(_start.y), static_cast<Sint16>(_end.x), static_cast<Sint16>(_end.y), _brush};
+	writeEvent(&event);
+}
+
+void Recorder::recordReset(const Simulation *_sim, Simulation::Material _mat)
+{
+	Event event = {_sim->getTick(), EventType::RESET, _mat, 0, 0, 0, 0, 0, Simulation::Brush::ROUND};
+	writeEvent(&event);
+}
+
+//Applies every event that was recorded before the simulation's current tick was updated
+void Recorder::replayTick(Simulation *_sim)
+{
+	while(replayPosition < events.size() && events[replayPosition].tick <= _sim->getTick())
+	{
+		const Event &event = events[replayPosition];
+		switch(event.type)
+		{
+		case EventType::STROKE:
+			_sim->setCellLine({event.startX, event.startY}, {event.endX, event.endY}, event.radius, event.material, event.brush);
+			break;
+
+		case EventType::RESET:
+			_sim->reset(event.material);
+			break;
+		}
+		++replayPosition;
+	}
+}
+
+void Recorder::writeEvent(const Event *_event)
+{
+	if(!file.is_open()) { return; }
+	char buffer[EVENT_SIZE];
+	memcpy(buffer, &_event->tick, sizeof(Uint32));
+	buffer[4] = static_cast<char>(_event->type);
+	buffer[5] = static_cast<char>(_event->material);
+	memcpy(buffer + 6, &_event->radius, sizeof(Uint16));
+	memcpy(buffer + 8, &_event->startX, sizeof(Sint16));
+	memcpy(buffer + 10, &_event->startY, sizeof(Sint16));
+	memcpy(buffer + 12, &_event->endX, sizeof(Sint16));
+	memcpy(buffer + 14, &_event->endY, sizeof(Sint16));
+	buffer[16] = static_cast<char>(_event->brush);
+	file.write(buffer, EVENT_SIZE);
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "SDL.h"
+#include "Simulation.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+const Uint32 RECORDING_MAGIC = 0x43455246; //"FREC"
+const Uint16 RECORDING_VERSION = 2;
+
+//Logs every brush stroke and reset together with the tick it happened on. A simulation created with the
+//recorded size and seed that is given the same input on the same ticks reproduces the session exactly
+class Recorder
+{
+public:
+	enum class EventType : Uint8
+	{
+		STROKE = 0,
+		RESET
+	};
+
+	struct Event
+	{
+		Uint32 tick;
+		EventType type;
+		Simulation::Material material;
+		Uint16 radius;
+		Sint16 startX, startY, endX, endY;
+		Simulation::Brush brush;
+	};
+
+	Recorder();
+	~Recorder();
+
+	bool startRecording(const std::string &_path, const Simulation *_sim);
+	bool loadReplay(const std::string &_path);
+
+	void recordStroke(const Simulation *_sim, SDL_Point _start, SDL_Point _end, Uint16 _rad, Simulation::Material _mat, Simulation::Brush _brush);
+	void recordReset(const Simulation *_sim, Simulation::Material _mat);
+	void replayTick(Simulation *_sim);
+	void rewind() { replayPosition = 0; };
+
+	bool isRecording() const { return file.is_open(); };
+	bool isReplayFinished() const { return replayPosition >= events.size(); };
+	Uint16 getWidth() const { return width; };
+	Uint16 getHeight() const { return height; };
+	Uint32 getSeed() const { return seed; };
+	Uint32 getLastTick() const { return events.empty() ? 0 : events.back().tick; };
+
+private:
+	Uint16 width, height;
+	Uint32 seed;
+	std::ofstream file;
+	std::vector<Event> events;
+	Uint64 replayPosition;
+
+	void writeEvent(const Event *_event);
+};
\ No newline at end of file
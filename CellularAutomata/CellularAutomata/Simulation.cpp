@@ -1,283 +1,1014 @@
 #include "Simulation.hpp"
 
-#include "Graphics.hpp"
+#include <cmath>
+#include <new>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
-Simulation::Simulation(int _width, int _height, Uint32 _pixelFormat)
+Simulation::Simulation(int _width, int _height, Uint32 _pixelFormat, Uint8 _threadCount)
 {
 	width = _width;
 	height = _height;
 	size = static_cast<Uint64>(_width) * static_cast<Uint64>(_height);
 
+	//Cells are stored with a one cell border of walls, so that a neighbour is always a single add away and never out of range
+	stride = width + 2;
+	paddedSize = static_cast<Uint64>(stride) * static_cast<Uint64>(height + 2);
+	const Sint8 offsetX[] = {-1, 0, 1, 1, 1, 0, -1, -1};
+	const Sint8 offsetY[] = {-1, -1, -1, 0, 1, 1, 1, 0};
+	for(int i = 0; i < static_cast<int>(Direction::TOTAL_DIRECTIONS); ++i) { neighbourOffsets[i] = offsetX[i] + offsetY[i] * stride; }
+
 	pixelFormat = SDL_AllocFormat(_pixelFormat);
 
-	mt = std::mt19937(std::time(0));
-	std::uniform_real_distribution<double> doubleDist(0.0, 1.0);
-	std::uniform_int_distribution<int> xorSeedDist(100000000);
+	//The grid is split into square chunks that each track the area that may change on the next tick,
+	//so that settled or empty regions cost nothing to update
+	chunksWide = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunksHigh = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkCount = chunksWide * chunksHigh;
 
-	computeBuffer = new Material[size];
-	drawBuffer = new Uint32[size];
-	reset();
-	batchNoise = new Uint16[size];
-	iterationNoise = new Uint32[size];
-	for(int i = 0; i < size; ++i)
+	//Heat is simulated on a coarser grid than the cells. Chunks are a whole number of blocks wide, so no block is shared by two chunks
+	heatWide = (width + HEAT_BLOCK - 1) / HEAT_BLOCK + 2;
+	heatHigh = (height + HEAT_BLOCK - 1) / HEAT_BLOCK + 2;
+	Uint32 heatSize = heatWide * heatHigh;
+
+	//Every buffer the size of the world is carved from one arena, in the order the tick touches them. The flood fill of a liquid
+	//body reaches each cell at most once, so its scratch space never needs more than a cell's worth of each list
+	Uint64 scratchSize = 3 * Arena::footprint<Uint32>(paddedSize);
+	if(!arena.reserve(Arena::footprint<Cell>(paddedSize) + Arena::footprint<Uint32>(paddedSize) + 4 * Arena::footprint<float>(heatSize) +
+		3 * Arena::footprint<DirtyRect>(chunkCount) + Arena::footprint<SDL_SpinLock>(chunkCount) + Arena::footprint<Uint32>(chunkCount) +
+		Arena::footprint<bool>(chunkCount) + Arena::footprint<Uint16>(CHUNK_SIZE * CHUNK_SIZE) + scratchSize))
+	{
+		throw std::bad_alloc();
+	}
+	computeBuffer = arena.carve<Cell>(paddedSize);
+	activeRects = arena.carve<DirtyRect>(chunkCount);
+	nextRects = arena.carve<DirtyRect>(chunkCount);
+	renderRects = arena.carve<DirtyRect>(chunkCount);
+	rectLocks = arena.carve<SDL_SpinLock>(chunkCount);
+	phaseChunks = arena.carve<Uint32>(chunkCount);
+	iterationNoise = arena.carve<Uint16>(CHUNK_SIZE * CHUNK_SIZE);
+	pressureMarks = arena.carve<Uint32>(paddedSize);
+	heat = arena.carve<float>(heatSize);
+	nextHeat = arena.carve<float>(heatSize);
+	heatSources = arena.carve<float>(heatSize);
+	heatPulls = arena.carve<float>(heatSize);
+	heatStale = arena.carve<bool>(chunkCount);
+	scratch = arena.carveArena(scratchSize);
+	for(int i = 0; i < chunkCount; ++i)
 	{
-		batchNoise[i] = i % (size / RAND_BATCH_SIZE) == 0 ? i / (size / RAND_BATCH_SIZE) : batchNoise[i - 1];
-		iterationNoise[i] = i;
+		activeRects[i] = nextRects[i] = renderRects[i] = {CHUNK_SIZE, CHUNK_SIZE, -1, -1};
+		rectLocks[i] = 0;
 	}
-	std::shuffle(batchNoise, batchNoise + size, mt);
-	std::shuffle(iterationNoise, iterationNoise + size, mt);
 
-	updatedCells = new boost::dynamic_bitset<Uint64>(size);
+	traversal = Traversal::SHUFFLED;
+	profiler = nullptr;
+	threadCount = 0;
+	workers = nullptr;
+	setThreadCount(_threadCount);
+
+	//Arena memory starts zeroed, so no cell has been marked by a flood fill yet
+	generation = 0;
+	pressureStamp = 0;
+	reset();
+	setSeed(static_cast<Uint32>(std::time(0)));
+
+	loadMaterials();
+	selectKernels();
+	bakePalettes();
+}
+
+//Loads in material properties from a json file. Materials are numbered in the order they appear, and any past what the tables
+//can hold are left out. Behavior sets can be biased by using duplicate behaviors. However, 
+//if less biased behaviors are not equally distributed from a left to right perspective, unwanted bias can occur.
+//Empty and the border walls are not part of the file, so their specs are built here rather than left as garbage
+void Simulation::loadMaterials()
+{
+	for(int i = 0; i < MAX_MATERIALS; ++i)
+	{
+		allSpecs[i] = MaterialSpecs();
+		allBehaviors[i] = MaterialBehavior();
+		allInfo[i] = MaterialInfo();
+		allHeat[i].heated = {Material::NO_MATERIAL, SDL_MAX_SINT8};
+		allHeat[i].cooled = {Material::NO_MATERIAL, SDL_MIN_SINT8};
+		for(int j = 0; j < MAX_MATERIALS; ++j) { reactionSlots[i][j] = 0; }
+	}
+	allInfo[0].name = "Empty";
+	allInfo[static_cast<int>(Material::WALL)].name = "Wall";
+	allSpecs[static_cast<int>(Material::WALL)].density = 255;
+	allSpecs[static_cast<int>(Material::WALL)].flags = FLAG_SOLID;
 
-	//Loads in material properties from a json file.
-	//Behavior sets can be biased by using duplicate behaviors. However, 
-	//if less biased behaviors are not equally distributed from a left to right perspective, unwanted bias can occur.
 	boost::property_tree::ptree root;
 	boost::property_tree::read_json(MATERIAL_FILE_PATH, root);
-	for(auto it = root.begin(); it != root.end(); ++it)
+	materialCount = 1;
+	for(auto it = root.begin(); it != root.end() && materialCount < static_cast<int>(Material::WALL); ++it)
 	{
-		int dist = std::distance(root.begin(), it);
-		if(dist >= static_cast<int>(Material::TOTAL_MATERIALS) - 1) { break; }
-		MaterialSpecs &mat = allSpecs[dist + 1];
-		mat.name = it->first;
+		MaterialSpecs &mat = allSpecs[materialCount];
+		MaterialBehavior &behavior = allBehaviors[materialCount];
+		MaterialInfo &info = allInfo[materialCount];
+		++materialCount;
+		info.name = it->first;
 		auto color = it->second.get_child("minColor");
-		mat.minColor = {color.get<Uint8>("h"), color.get<Uint8>("s"), color.get<Uint8>("v")};
+		info.minColor = {color.get<Uint8>("h"), color.get<Uint8>("s"), color.get<Uint8>("v")};
 		color = it->second.get_child("maxColor");
-		mat.maxColor = {color.get<Uint8>("h"), color.get<Uint8>("s"), color.get<Uint8>("v")};
-		mat.minSpeed = it->second.get<Uint8>("minSpeed");
-		mat.maxSpeed = it->second.get<Uint8>("maxSpeed");
+		info.maxColor = {color.get<Uint8>("h"), color.get<Uint8>("s"), color.get<Uint8>("v")};
+		info.temperature = it->second.get<Sint8>("temperature", 0);
+		mat.maxSpeed = std::min(it->second.get<Uint8>("maxSpeed"), MAX_SPEED);
+		mat.minSpeed = std::min(it->second.get<Uint8>("minSpeed"), mat.maxSpeed);
 		mat.density = it->second.get<Uint8>("density");
 		mat.deathChance = it->second.get<Uint8>("deathChance");
-		mat.solid = it->second.get<bool>("solid");
-		mat.flaming = it->second.get<bool>("flaming");
-		mat.flammable = it->second.get<bool>("flammable");
-		mat.melting = it->second.get<bool>("melting");
-		mat.meltable = it->second.get<bool>("meltable");
+		if(it->second.get<bool>("solid")) { mat.flags |= FLAG_SOLID; }
+		if(it->second.get<bool>("pressurised", false)) { mat.flags |= FLAG_PRESSURISED; }
+		//Sets and directions past the limits are dropped, like reaction outcomes. A direction that does not exist would read past
+		//the neighbour offsets, so it is reported as bad data in the same way a value of the wrong type is
 		int i = 0;
 		for(auto arr : it->second.get_child("behavior"))
 		{
+			if(i >= MAX_BEHAVIOR_SETS) { break; }
 			int j = 0;
 			for(auto dir : arr.second)
 			{
-				mat.behavior[i][j] = static_cast<Direction>(dir.second.get_value<int>());
+				if(j >= MAX_BEHAVIORS_PER_SET) { break; }
+				int value = dir.second.get_value<int>();
+				if(value < 0 || value >= static_cast<int>(Direction::TOTAL_DIRECTIONS))
+				{
+					throw boost::property_tree::ptree_bad_data("direction out of range in the behavior of " + info.name, value);
+				}
+				behavior.directions[i][j] = static_cast<Direction>(value);
 				++j;
 			}
-			mat.behaviorCounts[i] = j;
+			behavior.counts[i] = j;
 			++i;
 		}
 		mat.behaviorSetCount = i;
 	}
+
+	//Reactions and heat transitions name other materials, which is why they are read once every material has been loaded.
+	//Burning and melting are not reactions, since they come from the heat around a cell rather than from touching it.
+	//The first list of outcomes is never used, so that a slot of zero can mean no reaction. A pair with no outcomes does not react
+	reactions.assign(1, Reaction());
+	for(auto it = root.begin(); it != root.end(); ++it)
+	{
+		Material self = findMaterial(it->first);
+		if(self == Material::NO_MATERIAL) { continue; }
+		MaterialHeat &mat = allHeat[static_cast<int>(self)];
+		auto heated = it->second.get_child_optional("heated");
+		auto cooled = it->second.get_child_optional("cooled");
+		if(heated) { mat.heated = {findMaterial(heated->get<std::string>("into")), heated->get<Sint8>("above")}; }
+		if(cooled) { mat.cooled = {findMaterial(cooled->get<std::string>("into")), cooled->get<Sint8>("below")}; }
+		if(mat.heated.into == Material::NO_MATERIAL) { mat.heated.threshold = SDL_MAX_SINT8; }
+		if(mat.cooled.into == Material::NO_MATERIAL) { mat.cooled.threshold = SDL_MIN_SINT8; }
+
+		auto list = it->second.get_child_optional("reactions");
+		if(!list) { continue; }
+		for(auto entry : *list)
+		{
+			Material with = findMaterial(entry.second.get<std::string>("with"));
+			if(with == Material::NO_MATERIAL) { continue; }
+			Uint8 &slot = reactionSlots[static_cast<int>(self)][static_cast<int>(with)];
+			if(slot == 0)
+			{
+				if(reactions.size() > SDL_MAX_UINT8) { continue; }
+				slot = static_cast<Uint8>(reactions.size());
+				reactions.push_back(Reaction());
+			}
+			Reaction &reaction = reactions[slot];
+			reaction.outcomeCount = 0;
+			for(auto outcome : entry.second.get_child("outcomes"))
+			{
+				if(reaction.outcomeCount >= MAX_REACTION_OUTCOMES) { break; }
+				reaction.outcomes[reaction.outcomeCount++] = {findMaterial(outcome.second.get<std::string>("self", "")),
+					findMaterial(outcome.second.get<std::string>("other", "")), outcome.second.get<Uint8>("chance")};
+			}
+			if(reaction.outcomeCount == 0) { slot = 0; }
+		}
+	}
+
+	//A material falls when it never dies and every direction it tries first is straight down, so it can be dropped a column at a time.
+	//It reacts when it has at least one list of outcomes in its row of the reaction table
+	for(int i = 0; i < MAX_MATERIALS; ++i)
+	{
+		MaterialSpecs &mat = allSpecs[i];
+		const MaterialBehavior &behavior = allBehaviors[i];
+		bool falls = mat.behaviorSetCount > 0 && behavior.counts[0] > 0 && mat.deathChance == 0;
+		for(int j = 0; j < behavior.counts[0] && falls; ++j) { falls = behavior.directions[0][j] == Direction::SOUTH; }
+		if(falls) { mat.flags |= FLAG_FALLS; }
+		for(int j = 0; j < MAX_MATERIALS; ++j)
+		{
+			if(reactions[reactionSlots[i][j]].outcomeCount > 0) { mat.flags |= FLAG_REACTS; }
+		}
+	}
+
+	//The further a cell's temperature is from zero, the harder it pulls its block toward it. Cells at zero only let heat slowly escape.
+	//Only blocks past the lowest threshold in either direction can change any cell
+	heatedMin = SDL_MAX_SINT8;
+	cooledMax = SDL_MIN_SINT8;
+	for(int i = 0; i < MAX_MATERIALS; ++i)
+	{
+		MaterialHeat &mat = allHeat[i];
+		mat.pull = HEAT_LOSS + HEAT_EXCHANGE * abs(allInfo[i].temperature) / SDL_MAX_SINT8;
+		mat.source = mat.pull * allInfo[i].temperature;
+		heatedMin = std::min<float>(heatedMin, mat.heated.threshold);
+		cooledMax = std::max<float>(cooledMax, mat.cooled.threshold);
+	}
 }
 
 Simulation::~Simulation()
 {
-	delete[] computeBuffer;
-	delete[] drawBuffer;
-	delete[] batchNoise;
-	delete[] iterationNoise;
-	delete updatedCells;
+	stopWorkers();
+	SDL_FreeFormat(pixelFormat);
+}
+
+//Hashes the material and colour of every cell, so that two runs can be checked for identical results.
+//Empty cells are never drawn, so their shade is left out and does not need to be saved in a snapshot
+Uint64 Simulation::getChecksum() const
+{
+	Uint64 hash = 14695981039346656037ULL;
+	for(int i = 0; i < paddedSize; ++i)
+	{
+		hash = (hash ^ static_cast<Uint8>(computeBuffer[i].material)) * 1099511628211ULL;
+		if(computeBuffer[i].material == Material::EMPTY) { continue; }
+		hash = (hash ^ computeBuffer[i].shade) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//Collects the areas that changed since the last call. Runs of neighbouring dirty chunks in a chunk row
+//are merged into one rect, which keeps the number of texture locks per frame small
+const std::vector<SDL_Rect> &Simulation::collectDirtyRegions()
+{
+	dirtyRegions.clear();
+	for(Uint32 cy = 0; cy < chunksHigh; ++cy)
+	{
+		SDL_Rect run = {0, 0, 0, 0};
+		for(Uint32 cx = 0; cx <= chunksWide; ++cx)
+		{
+			DirtyRect *rect = cx < chunksWide ? &renderRects[cy * chunksWide + cx] : nullptr;
+			if(!rect || rect->minX > rect->maxX)
+			{
+				if(run.w > 0) { dirtyRegions.push_back(run); }
+				run.w = 0;
+				continue;
+			}
+
+			SDL_Rect area = {static_cast<int>(cx * CHUNK_SIZE + rect->minX), static_cast<int>(cy * CHUNK_SIZE + rect->minY),
+				rect->maxX - rect->minX + 1, rect->maxY - rect->minY + 1};
+			area.w = std::min(area.w, width - area.x);
+			area.h = std::min(area.h, height - area.y);
+			if(run.w > 0) { SDL_UnionRect(&run, &area, &run); }
+			else { run = area; }
+			*rect = {CHUNK_SIZE, CHUNK_SIZE, -1, -1};
+		}
+	}
+	return dirtyRegions;
+}
+
+//Expands the palette entry of every cell in an area copied out with readCells into ARGB pixels, where _cells and _pixels point
+//at the area's top left corner. This is a single pass over each row with no branches. It reads nothing but the palettes,
+//which never change once the simulation is built, so it can run on another thread while the simulation updates
+void Simulation::renderCells(const SDL_Rect *_area, const Cell *_cells, int _cellPitch, Uint32 *_pixels, int _pitch) const
+{
+	const Uint32 *palette = &pixelPalettes[0][0];
+	for(int y = 0; y < _area->h; ++y)
+	{
+		const Cell *__restrict row = _cells + y * _cellPitch;
+		Uint32 *__restrict out = reinterpret_cast<Uint32 *>(reinterpret_cast<Uint8 *>(_pixels) + y * _pitch);
+		for(int x = 0; x < _area->w; ++x) { out[x] = palette[static_cast<int>(row[x].material) * PALETTE_SIZE + row[x].shade]; }
+	}
+}
+
+//Copies an area of cells out of the grid. The pitch is the number of cells between the starts of two rows in the output
+void Simulation::readCells(const SDL_Rect *_area, Cell *_cells, int _pitch) const
+{
+	for(int y = 0; y < _area->h; ++y)
+	{
+		memcpy(_cells + y * _pitch, computeBuffer + getIndex(_area->x, _area->y + y), _area->w * sizeof(Cell));
+	}
+}
+
+//Copies an area of cells into the grid, then wakes and redraws it. Written cells carry the generation of the last tick like a drawn cell,
+//so the next tick moves past it and updates them normally
+void Simulation::writeCells(const SDL_Rect *_area, const Cell *_cells, int _pitch)
+{
+	for(int y = 0; y < _area->h; ++y)
+	{
+		Cell *row = computeBuffer + getIndex(_area->x, _area->y + y);
+		memcpy(row, _cells + y * _pitch, _area->w * sizeof(Cell));
+		for(int x = 0; x < _area->w; ++x) { row[x].generation = generation; }
+	}
+	Sint32 maxX = _area->x + _area->w - 1;
+	Sint32 maxY = _area->y + _area->h - 1;
+
+	//Heat is not stored with the cells, so the blocks written over start again at zero
+	for(Sint32 by = _area->y / HEAT_BLOCK; by <= maxY / HEAT_BLOCK; ++by)
+	{
+		for(Sint32 bx = _area->x / HEAT_BLOCK; bx <= maxX / HEAT_BLOCK; ++bx) { heat[(by + 1) * heatWide + bx + 1] = 0.0f; }
+	}
+	for(Sint32 cy = _area->y / CHUNK_SIZE; cy <= maxY / CHUNK_SIZE; ++cy)
+	{
+		for(Sint32 cx = _area->x / CHUNK_SIZE; cx <= maxX / CHUNK_SIZE; ++cx) { renderRects[cy * chunksWide + cx] = {0, 0, CHUNK_SIZE - 1, CHUNK_SIZE - 1}; }
+	}
+	wakeArea(_area->x - 1, _area->y - 1, maxX + 1, maxY + 1);
+}
+
+void Simulation::setPixelFormat(Uint32 _pixelFormat)
+{
 	SDL_FreeFormat(pixelFormat);
+	pixelFormat = SDL_AllocFormat(_pixelFormat);
+	mapPalettes();
 }
 
 std::string Simulation::getMaterialString() const
 {
 	std::string result = std::string();
-	for(int i = 1; i < static_cast<int>(Material::TOTAL_MATERIALS); ++i)
+	for(int i = 1; i < materialCount; ++i)
 	{
-		result += allSpecs[i].name;
+		result += allInfo[i].name;
 		result += ' ';
 	}
 	return result;
 }
 
+//Looks up a material by the name it has in the material file. Unknown names give NO_MATERIAL
+Simulation::Material Simulation::findMaterial(const std::string &_name) const
+{
+	for(int i = 0; i < materialCount; ++i)
+	{
+		if(allInfo[i].name == _name) { return static_cast<Material>(i); }
+	}
+	return _name == allInfo[static_cast<int>(Material::WALL)].name ? Material::WALL : Material::NO_MATERIAL;
+}
+
 void Simulation::update()
 {
-	//Because RNG is the main computational bottleneck, we create only a fraction of the needed numbers,
-	//then pick them using a pre-generated noise array. Each random number is used only with the modulo operator,
-	//so we can reuse each number several times by dividing by ten after each use.
-	Uint32 *randBatch = new Uint32[RAND_BATCH_SIZE];
-	for(int i = 0; i < RAND_BATCH_SIZE; ++i) { randBatch[i] = xorshift128(); }
+	Profiler::ScopedTimer timer(profiler, Profiler::Timer::TICK);
+
+	//Everything woken during the last tick is updated now, and anything that changes now wakes chunks for the next tick
+	std::swap(activeRects, nextRects);
+	for(int i = 0; i < chunkCount; ++i) { nextRects[i] = {CHUNK_SIZE, CHUNK_SIZE, -1, -1}; }
+
+	//A cell counts as updated when it carries the current generation, so moving to the next generation clears every flag at once.
+	//Before the counter wraps, every cell is stamped back to zero so that an old stamp can never match a new generation
+	if(++generation == 0)
+	{
+		for(int i = 0; i < paddedSize; ++i) { computeBuffer[i].generation = 0; }
+		generation = 1;
+	}
+
+	//Falling cells are dropped a whole column at a time before anything else moves. Workers take a column of chunks each,
+	//since a cell dropped straight down never leaves its column
+	phaseChunkCount = 0;
+	for(Uint32 cx = 0; cx < chunksWide; ++cx)
+	{
+		for(Uint32 cy = 0; cy < chunksHigh; ++cy)
+		{
+			if(activeRects[cy * chunksWide + cx].minX > activeRects[cy * chunksWide + cx].maxX) { continue; }
+			phaseChunks[phaseChunkCount++] = cx;
+			break;
+		}
+	}
+	droppingColumns = true;
+	if(phaseChunkCount > 0) { runPool(); }
+	droppingColumns = false;
+
+	//Phases are run in a random order so that chunk borders do not introduce a directional bias
+	Uint8 phaseOrder[CHUNK_PHASES] = {0, 1, 2, 3};
+	for(int i = CHUNK_PHASES - 1; i > 0; --i) { std::swap(phaseOrder[i], phaseOrder[mainRng() % (i + 1)]); }
+	for(int i = 0; i < CHUNK_PHASES; ++i)
+	{
+		phaseChunkCount = 0;
+		for(Uint32 cy = phaseOrder[i] / 2; cy < chunksHigh; cy += 2)
+		{
+			for(Uint32 cx = phaseOrder[i] % 2; cx < chunksWide; cx += 2)
+			{
+				Uint32 chunk = cy * chunksWide + cx;
+				if(activeRects[chunk].minX <= activeRects[chunk].maxX) { phaseChunks[phaseChunkCount++] = chunk; }
+			}
+		}
+		if(phaseChunkCount > 0) { runPool(); }
+	}
+	if(tick % PRESSURE_INTERVAL == 0) { levelLiquids(); }
+
+	//Any chunk that was awake may have changed, so the heat its cells give off is summed again on the next heat step.
+	//Heat steps fall between pressure passes so that the two never add to the same tick
+	for(Uint32 i = 0; i < chunkCount; ++i) { heatStale[i] = heatStale[i] || activeRects[i].minX <= activeRects[i].maxX || nextRects[i].minX <= nextRects[i].maxX; }
+	if(tick % HEAT_INTERVAL == HEAT_INTERVAL - 1) { updateHeat(); }
+	++tick;
+	timer.stop();
+	if(profiler) { profiler->endTick(tick); }
+}
+
+//Restarts every source of randomness from a seed. A simulation that is given the same seed, size and input
+//produces the same result on every tick regardless of its thread count
+void Simulation::setSeed(Uint32 _seed)
+{
+	seed = _seed;
+	tick = 0;
+	mt = std::mt19937(seed);
+	mainRng = seedXorshift();
+	for(int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; ++i) { iterationNoise[i] = i; }
+	std::shuffle(iterationNoise, iterationNoise + CHUNK_SIZE * CHUNK_SIZE, mt);
+}
+
+//Replaces the worker pool. The calling thread always acts as the first worker
+void Simulation::setThreadCount(Uint8 _threadCount)
+{
+	stopWorkers();
+	threadCount = std::max<Uint8>(_threadCount, 1);
+
+	poolGeneration = 0;
+	poolPending = 0;
+	poolStopping = false;
+	if(threadCount > 1)
+	{
+		workers = new std::thread[threadCount - 1];
+		for(int i = 0; i < threadCount - 1; ++i) { workers[i] = std::thread(&Simulation::workerLoop, this); }
+	}
+}
+
+//Runs the current phase on every worker and waits for all of them to finish. The calling thread always acts as the first worker
+void Simulation::runPool()
+{
+	phaseNext = 0;
+	if(threadCount > 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			poolPending = threadCount - 1;
+			++poolGeneration;
+		}
+		poolWake.notify_all();
+		runPhase();
+		std::unique_lock<std::mutex> lock(poolMutex);
+		poolDone.wait(lock, [&] { return poolPending == 0; });
+	}
+	else
+	{
+		runPhase();
+	}
+}
+
+void Simulation::runPhase()
+{
+	for(Uint32 i = phaseNext++; i < phaseChunkCount; i = phaseNext++)
+	{
+		if(droppingColumns) { dropColumns(phaseChunks[i]); }
+		else { updateChunk(phaseChunks[i]); }
+	}
+}
+
+void Simulation::workerLoop()
+{
+	Uint32 generation = 0;
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			poolWake.wait(lock, [&] { return poolStopping || poolGeneration != generation; });
+			if(poolStopping) { return; }
+			generation = poolGeneration;
+		}
+		runPhase();
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			if(--poolPending == 0) { poolDone.notify_one(); }
+		}
+	}
+}
+
+void Simulation::stopWorkers()
+{
+	if(!workers) { return; }
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		poolStopping = true;
+	}
+	poolWake.notify_all();
+	for(int i = 0; i < threadCount - 1; ++i) { workers[i].join(); }
+	delete[] workers;
+	workers = nullptr;
+}
+
+void Simulation::updateChunk(Uint32 _chunk)
+{
+	//Each chunk gets its own generator derived from the seed and tick, so the result does not depend on which worker runs it
+	Xorshift128 rng = {mix32(seed ^ 0x9E3779B9) | 1, mix32(tick + 0x7F4A7C15), mix32(_chunk + 0x85EBCA6B), mix32(seed + tick + _chunk)};
+
+	const DirtyRect &rect = activeRects[_chunk];
+	Uint32 originX = (_chunk % chunksWide) * CHUNK_SIZE;
+	Uint32 originY = (_chunk / chunksWide) * CHUNK_SIZE;
+
+	//Every cell's random number depends only on its index, the tick and the seed. They are made a row at a time for
+	//just the awake part of the chunk, into a buffer on the stack. Each number is used only with the modulo operator,
+	//so a cell can reuse its number several times by dividing by ten after each use.
+	Uint32 noise[CHUNK_SIZE * CHUNK_SIZE];
+	Uint32 key = mix32(seed ^ mix32(tick + 0x9E3779B9));
+	{
+		Profiler::ScopedTimer timer(profiler, Profiler::Timer::RANDOM_FILL);
+		for(Sint16 y = rect.minY; y <= rect.maxY; ++y)
+		{
+			fillRandom(noise + y * CHUNK_SIZE + rect.minX, getIndex(originX + rect.minX, originY + y), rect.maxX + 1 - rect.minX, key);
+		}
+	}
+
+	//Counting is kept to a pair of compares per cell and is added to the profiler once per chunk.
+	//Times are summed over every worker, so they measure work rather than the length of the tick
+	Profiler::ScopedTimer timer(profiler, Profiler::Timer::CELL_UPDATE);
+	bool counting = profiler && profiler->isEnabled();
+	Uint32 visited = 0, skipped = 0, moved = 0;
+	auto visit = [&](Sint16 _x, Sint16 _y)
+	{
+		Uint32 index = getIndex(originX + _x, originY + _y);
+		Cell before = computeBuffer[index];
+		if(before.material == Material::EMPTY || before.generation == generation)
+		{
+			++skipped;
+			return;
+		}
+		(this->*kernels[static_cast<int>(before.material)])(index, noise[_y * CHUNK_SIZE + _x], rng);
+		++visited;
+		if(counting && (computeBuffer[index].material != before.material || computeBuffer[index].shade != before.shade)) { ++moved; }
+	};
+
+	if(traversal == Traversal::SWEEP)
+	{
+		//Rows are walked from the bottom up and in memory order, with the direction of each row flipping by row and tick
+		//so that neither side is favoured over time
+		for(Sint16 y = rect.maxY; y >= rect.minY; --y)
+		{
+			if((originY + y + tick) & 1) { for(Sint16 x = rect.maxX; x >= rect.minX; --x) { visit(x, y); } }
+			else { for(Sint16 x = rect.minX; x <= rect.maxX; ++x) { visit(x, y); } }
+		}
+	}
+	else
+	{
+		for(int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; ++i)
+		{
+			//In order to not prefer a certain direction of movement, we have to iterate through each chunk in a random way
+			Sint16 x = iterationNoise[i] % CHUNK_SIZE;
+			Sint16 y = iterationNoise[i] / CHUNK_SIZE;
+			if(x < rect.minX || x > rect.maxX || y < rect.minY || y > rect.maxY) { continue; }
+			visit(x, y);
+		}
+	}
+
+	if(counting)
+	{
+		profiler->addCount(Profiler::Counter::CELLS_VISITED, visited);
+		profiler->addCount(Profiler::Counter::CELLS_SKIPPED, skipped);
+		profiler->addCount(Profiler::Counter::CELLS_MOVED, moved);
+	}
+}
+
+//Drops every run of falling cells in a column of chunks that has empty cells under it, as one shift per run. Each column of cells
+//is walked from the bottom up across every awake chunk, so a run can fall into the gap left by the one below it on the same tick.
+//A run falls as far as its bottom cell would have on its own, and takes its shades with it
+void Simulation::dropColumns(Uint32 _chunkX)
+{
+	Profiler::ScopedTimer timer(profiler, Profiler::Timer::CELL_UPDATE);
+	Uint32 key = mix32(seed ^ mix32(tick + 0x9E3779B9));
+	Uint32 moved = 0;
+	Sint32 originX = _chunkX * CHUNK_SIZE;
+	for(Sint32 x = originX; x < std::min<Sint32>(originX + CHUNK_SIZE, width); ++x)
+	{
+		Sint32 next = height - 1;
+		for(Sint32 cy = chunksHigh - 1; cy >= 0; --cy)
+		{
+			const DirtyRect &rect = activeRects[cy * chunksWide + _chunkX];
+			if(x - originX < rect.minX || x - originX > rect.maxX) { continue; }
+			for(Sint32 y = std::min<Sint32>(cy * CHUNK_SIZE + rect.maxY, next); y >= cy * CHUNK_SIZE + rect.minY; --y)
+			{
+				Uint32 index = getIndex(x, y);
+				const MaterialSpecs &mat = allSpecs[static_cast<int>(computeBuffer[index].material)];
+				if(!(mat.flags & FLAG_FALLS) || computeBuffer[index + stride].material != Material::EMPTY) { continue; }
+
+				Uint32 randi;
+				fillRandom(&randi, index, 1, key);
+				Uint8 speed = mat.minSpeed + randi % (mat.maxSpeed + 1 - mat.minSpeed);
+				Uint32 fall = 1;
+				while(fall < speed && computeBuffer[index + (fall + 1) * stride].material == Material::EMPTY) { ++fall; }
+				Uint32 top = index;
+				while(computeBuffer[top - stride].material == computeBuffer[index].material) { top -= stride; }
+
+				//Cells are copied from the bottom up, so that each is read before anything is written over it
+				Uint32 length = (index - top) / stride + 1;
+				Uint32 offset = fall * stride;
+				for(Uint32 i = 0; i < length; ++i)
+				{
+					computeBuffer[index - i * stride + offset] = computeBuffer[index - i * stride];
+					computeBuffer[index - i * stride + offset].generation = generation;
+				}
+				for(Uint32 i = 0; i < fall; ++i) { computeBuffer[top + i * stride] = {Material::EMPTY, 0, generation}; }
+				markAreaChanged(x, y - length + 1, x, y + fall);
+				moved += length;
+				y -= length - 1;
+				next = y - 1;
+			}
+		}
+	}
+	if(profiler && profiler->isEnabled()) { profiler->addCount(Profiler::Counter::CELLS_MOVED, moved); }
+}
+
+//Levels every body of pressurised liquid that reaches into an awake area. A body is every cell of one liquid joined by their sides,
+//and bodies are found in index order on one thread so that the result does not depend on the thread count.
+//A body can only level through an empty cell beside or above it, so fills are only started from cells that touch one
+//and a grid full of settled liquid costs a single pass over its awake cells
+void Simulation::levelLiquids()
+{
+	Profiler::ScopedTimer timer(profiler, Profiler::Timer::PRESSURE);
+	if(++pressureStamp == 0)
+	{
+		memset(pressureMarks, 0, paddedSize * sizeof(Uint32));
+		pressureStamp = 1;
+	}
+	for(Uint32 chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		const DirtyRect &rect = activeRects[chunk];
+		Uint32 originX = (chunk % chunksWide) * CHUNK_SIZE;
+		Uint32 originY = (chunk / chunksWide) * CHUNK_SIZE;
+		for(Sint16 y = rect.minY; y <= rect.maxY; ++y)
+		{
+			for(Sint16 x = rect.minX; x <= rect.maxX; ++x)
+			{
+				Uint32 index = getIndex(originX + x, originY + y);
+				if(!(allSpecs[static_cast<int>(computeBuffer[index].material)].flags & FLAG_PRESSURISED) || pressureMarks[index] == pressureStamp) { continue; }
+				if(computeBuffer[getRelative(index, Direction::NORTH)].material == Material::EMPTY ||
+					computeBuffer[getRelative(index, Direction::EAST)].material == Material::EMPTY ||
+					computeBuffer[getRelative(index, Direction::WEST)].material == Material::EMPTY)
+				{
+					levelBody(index);
+				}
+			}
+		}
+	}
+}
+
+//Moves the highest surface cells of a body straight into the lowest empty cells beside or above it, as long as that lowers them.
+//Liquid then finds its level through any path it fills, such as the pipe between two vessels, instead of by random walking.
+//Only cells that rest on something are moved or filled, so anything over empty space is left to fall normally.
+//The fill stops at chunks that are asleep, since liquid there has settled. Cells moved at the edge of the fill wake the chunks
+//beside them, so a body larger than the awake area still levels, a few chunks per pass
+void Simulation::levelBody(Uint32 _seed)
+{
+	Material mat = computeBuffer[_seed].material;
+	scratch.reset();
+	Uint32 *bodyStack = scratch.carve<Uint32>(paddedSize);
+	Uint32 *bodySurfaces = scratch.carve<Uint32>(paddedSize);
+	Uint32 *bodyOutlets = scratch.carve<Uint32>(paddedSize);
+	Uint32 stackSize = 0, surfaceCount = 0, outletCount = 0;
+	bodyStack[stackSize++] = _seed;
+	pressureMarks[_seed] = pressureStamp;
+	const Direction sides[] = {Direction::NORTH, Direction::EAST, Direction::SOUTH, Direction::WEST};
+	auto isAwake = [&](Uint32 _index)
+	{
+		const DirtyRect &rect = activeRects[((_index / stride - 1) / CHUNK_SIZE) * chunksWide + (_index % stride - 1) / CHUNK_SIZE];
+		return rect.minX <= rect.maxX;
+	};
+	while(stackSize > 0)
+	{
+		Uint32 index = bodyStack[--stackSize];
+		bool resting = computeBuffer[getRelative(index, Direction::SOUTH)].material != Material::EMPTY;
+		for(Direction side : sides)
+		{
+			Uint32 next = getRelative(index, side);
+			if(computeBuffer[next].material == mat)
+			{
+				if(pressureMarks[next] == pressureStamp || !isAwake(next)) { continue; }
+				pressureMarks[next] = pressureStamp;
+				bodyStack[stackSize++] = next;
+			}
+			else if(computeBuffer[next].material == Material::EMPTY && side != Direction::SOUTH)
+			{
+				if(side == Direction::NORTH && resting) { bodySurfaces[surfaceCount++] = index; }
+				if(pressureMarks[next] == pressureStamp || computeBuffer[getRelative(next, Direction::SOUTH)].material == Material::EMPTY) { continue; }
+				pressureMarks[next] = pressureStamp;
+				bodyOutlets[outletCount++] = next;
+			}
+		}
+	}
 
-	updatedCells->reset();
-	for(int i = 0; i < size; ++i)
+	//Surfaces are taken from the top and outlets from the bottom. Outlets in the same row alternate sides by tick
+	Uint32 moves = std::min<Uint32>({surfaceCount, outletCount, PRESSURE_MAX_MOVES});
+	if(moves == 0) { return; }
+	bool leftFirst = tick & 1;
+	std::partial_sort(bodySurfaces, bodySurfaces + moves, bodySurfaces + surfaceCount);
+	std::partial_sort(bodyOutlets, bodyOutlets + moves, bodyOutlets + outletCount, [&](Uint32 _a, Uint32 _b)
 	{
-		//In order to not prefer a certain direction of movement, we have to iterate through the array in a random way
-		Uint32 index = iterationNoise[i];
-		if(computeBuffer[index] == Material::EMPTY || updatedCells->test(index)) { continue; }
+		if(_a / stride != _b / stride) { return _a > _b; }
+		return leftFirst ? _a < _b : _a > _b;
+	});
+	for(Uint32 i = 0; i < moves && bodyOutlets[i] / stride > bodySurfaces[i] / stride; ++i) { swapCell(bodySurfaces[i], bodyOutlets[i]); }
+}
 
-		const MaterialSpecs *matSpecs = &allSpecs[static_cast<int>(computeBuffer[index])];
-		if(matSpecs->behaviorSetCount == 0) { continue; }
+//Moves heat between neighbouring blocks and toward the temperature of the cells in each block, then changes cells in any block
+//that is past a threshold of their material. Each block is solved against its neighbours' last heat, which stays stable however
+//hard its cells pull. The stencil has no branches, so the compiler can turn it into vector instructions
+void Simulation::updateHeat()
+{
+	Profiler::ScopedTimer timer(profiler, Profiler::Timer::HEAT);
+	for(Uint32 chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		if(!heatStale[chunk]) { continue; }
+		sumHeatSources(chunk);
+		heatStale[chunk] = false;
+	}
 
-		Uint32 randi = randBatch[batchNoise[index]];
-		auto preGenRandRange = [&](Uint8 _min, Uint8 _max)
+	for(Uint32 y = 1; y < heatHigh - 1; ++y)
+	{
+		const float *__restrict above = heat + (y - 1) * heatWide;
+		const float *__restrict row = heat + y * heatWide;
+		const float *__restrict below = heat + (y + 1) * heatWide;
+		const float *__restrict sources = heatSources + y * heatWide;
+		const float *__restrict pulls = heatPulls + y * heatWide;
+		float *__restrict out = nextHeat + y * heatWide;
+		for(Uint32 x = 1; x < heatWide - 1; ++x)
 		{
-			if(_min == _max) { return _min; }
-			Uint8 result = _min + randi % (_max + 1 - _min);
-			randi *= 0.1;
-			return result;
-		};
+			out[x] = (row[x] + HEAT_DIFFUSION * (above[x] + below[x] + row[x - 1] + row[x + 1]) + sources[x]) / (1.0f + 4.0f * HEAT_DIFFUSION + pulls[x]);
+		}
+	}
+	std::swap(heat, nextHeat);
 
-		if(matSpecs->deathChance > 0)
+	//Most blocks sit between every threshold, so only the cells of hot and cold blocks are looked at.
+	//Each cell past a threshold changes with a fixed chance, so that a block does not change all at once
+	for(Uint32 by = 1; by < heatHigh - 1; ++by)
+	{
+		for(Uint32 bx = 1; bx < heatWide - 1; ++bx)
 		{
-			if(preGenRandRange(1, matSpecs->deathChance) == 1)
+			float temperature = heat[by * heatWide + bx];
+			if(temperature <= heatedMin && temperature >= cooledMax) { continue; }
+			Sint32 maxX = std::min<Sint32>(bx * HEAT_BLOCK, width);
+			Sint32 maxY = std::min<Sint32>(by * HEAT_BLOCK, height);
+			for(Sint32 y = (by - 1) * HEAT_BLOCK; y < maxY; ++y)
 			{
-				setCell(index, Material::EMPTY);
-				continue;
+				for(Sint32 x = (bx - 1) * HEAT_BLOCK; x < maxX; ++x)
+				{
+					Uint32 index = getIndex(x, y);
+					const MaterialHeat &mat = allHeat[static_cast<int>(computeBuffer[index].material)];
+					const HeatTransition *transition = temperature > mat.heated.threshold ? &mat.heated : temperature < mat.cooled.threshold ? &mat.cooled : nullptr;
+					if(transition && mainRng() % HEAT_TRANSITION_CHANCE == 0) { setCell(index, transition->into, mainRng); }
+				}
 			}
 		}
+	}
+}
 
-		bool moved = false;
-		Uint8 speed = preGenRandRange(matSpecs->minSpeed, matSpecs->maxSpeed);
+//Adds up how hard the cells in each block of a chunk pull on it, and the heat that pulling brings in at zero
+void Simulation::sumHeatSources(Uint32 _chunk)
+{
+	Uint32 originX = (_chunk % chunksWide) * CHUNK_SIZE;
+	Uint32 originY = (_chunk / chunksWide) * CHUNK_SIZE;
+	Uint32 maxX = std::min<Uint32>(originX + CHUNK_SIZE, width);
+	Uint32 maxY = std::min<Uint32>(originY + CHUNK_SIZE, height);
+	Uint32 blocksWide = (maxX - originX + HEAT_BLOCK - 1) / HEAT_BLOCK;
+	for(Uint32 by = originY / HEAT_BLOCK; by < (maxY + HEAT_BLOCK - 1) / HEAT_BLOCK; ++by)
+	{
+		Uint32 first = (by + 1) * heatWide + originX / HEAT_BLOCK + 1;
+		std::fill(heatSources + first, heatSources + first + blocksWide, 0.0f);
+		std::fill(heatPulls + first, heatPulls + first + blocksWide, 0.0f);
+	}
+	for(Uint32 y = originY; y < maxY; ++y)
+	{
+		const Cell *row = computeBuffer + getIndex(0, y);
+		float *sources = heatSources + (y / HEAT_BLOCK + 1) * heatWide + 1;
+		float *pulls = heatPulls + (y / HEAT_BLOCK + 1) * heatWide + 1;
+		for(Uint32 x = originX; x < maxX; ++x)
+		{
+			const MaterialHeat &mat = allHeat[static_cast<int>(row[x].material)];
+			sources[x / HEAT_BLOCK] += mat.source;
+			pulls[x / HEAT_BLOCK] += mat.pull;
+		}
+	}
+}
 
-		//Attempts to move the cell by all defined behavior sets in order of preference
-		for(int j = 0; j < matSpecs->behaviorSetCount; ++j)
+//Gives every material the kernel compiled for exactly the three properties its update depends on: whether it mixes,
+//which is every material that is not solid, whether it can die and whether it reacts. Each property a material lacks removes its checks.
+//With the shipped materials, sand and gravel are plain solids, lava, oil and gas plain fluids, water a reactive fluid,
+//and fire, steam and plasma short-lived fluids
+void Simulation::selectKernels()
+{
+	const CellKernel archetypes[8] = {
+		&Simulation::updateCell<false, false, false>, //Solid
+		&Simulation::updateCell<false, false, true>, //Reactive solid
+		&Simulation::updateCell<false, true, false>, //Short-lived solid
+		&Simulation::updateCell<false, true, true>, //Short-lived reactive solid
+		&Simulation::updateCell<true, false, false>, //Fluid
+		&Simulation::updateCell<true, false, true>, //Reactive fluid
+		&Simulation::updateCell<true, true, false>, //Short-lived fluid
+		&Simulation::updateCell<true, true, true> //Short-lived reactive fluid
+	};
+	for(int i = 0; i < MAX_MATERIALS; ++i)
+	{
+		const MaterialSpecs &mat = allSpecs[i];
+		const MaterialBehavior &behavior = allBehaviors[i];
+		bool solid = mat.flags & FLAG_SOLID;
+		bool reacts = mat.flags & FLAG_REACTS;
+		bool moves = false;
+		for(int j = 0; j < mat.behaviorSetCount; ++j) { moves |= behavior.counts[j] > 0; }
+
+		//Static materials never change by themselves. Anything that can move, die or mix needs a real update
+		if(mat.behaviorSetCount == 0 || (!moves && solid && mat.deathChance == 0))
+		{
+			kernels[i] = &Simulation::updateStatic;
+			continue;
+		}
+		kernels[i] = archetypes[!solid << 2 | (mat.deathChance > 0) << 1 | reacts];
+	}
+}
+
+//Moves a cell by its material's behaviours. Each template flag is exactly one property of the material, so a false flag
+//removes a group of checks the material can never pass, while a true flag keeps the check against its specs
+template<bool Mixes, bool Dies, bool Reacts>
+void Simulation::updateCell(Uint32 _index, Uint32 _randi, Xorshift128 &_rng)
+{
+	const MaterialSpecs *matSpecs = &allSpecs[static_cast<int>(computeBuffer[_index].material)];
+	const MaterialBehavior *behavior = &allBehaviors[static_cast<int>(computeBuffer[_index].material)];
+
+	auto preGenRandRange = [&](Uint8 _min, Uint8 _max)
+	{
+		if(_min == _max) { return _min; }
+		Uint8 result = _min + _randi % (_max + 1 - _min);
+		_randi *= 0.1;
+		return result;
+	};
+
+	if(Dies && matSpecs->deathChance > 0)
+	{
+		if(preGenRandRange(1, matSpecs->deathChance) == 1)
 		{
-			if(moved) { break; }
+			setCell(_index, Material::EMPTY, _rng);
+			return;
+		}
+		//Cells that can die at random must keep their chunk awake even when they cannot move
+		wakeCell(_index);
+	}
+
+	bool moved = false;
+	Uint8 speed = preGenRandRange(matSpecs->minSpeed, matSpecs->maxSpeed);
+
+	//Attempts to move the cell by all defined behavior sets in order of preference
+	for(int j = 0; j < matSpecs->behaviorSetCount; ++j)
+	{
+		if(moved) { break; }
 
-			//Tries each direction in each behavior set, starting from a random one.
-			Uint8 directionIndex = preGenRandRange(0, matSpecs->behaviorCounts[j] - 1);
-			for(int k = 0; k < matSpecs->behaviorCounts[j]; ++k)
+		//Tries each direction in each behavior set, starting from a random one.
+		Uint8 directionIndex = preGenRandRange(0, behavior->counts[j] - 1);
+		for(int k = 0; k < behavior->counts[j]; ++k)
+		{
+			Direction direction = behavior->directions[j][directionIndex];
+			Uint32 lastIndex = _index;
+			bool destroyed = false;
+			for(int l = 0; l < speed; ++l)
 			{
-				Direction direction = matSpecs->behavior[j][directionIndex];
-				Uint32 lastIndex = index;
-				bool destroyed = false;
-				for(int l = 0; l < speed; ++l)
+				Uint32 newIndex = getRelative(lastIndex, direction);
+				if(computeBuffer[newIndex].material != Material::EMPTY)
 				{
-					Uint32 newIndex = getRelative(lastIndex, direction);
-					if(newIndex == -1) { break; }
-					if(computeBuffer[newIndex] != Material::EMPTY)
+					//Chemical reactions cost one lookup into the table for this pair of materials. A reaction that changes
+					//the moving cell destroys it, so it is not moved afterwards
+					Uint8 slot = Reacts ? reactionSlots[static_cast<int>(computeBuffer[_index].material)][static_cast<int>(computeBuffer[newIndex].material)] : 0;
+					if(slot != 0)
 					{
-						//Chemical and physical reactions. General properties use booleans, while specific interactions are hard coded
-						const MaterialSpecs *collisionSpecs = &allSpecs[static_cast<int>(computeBuffer[newIndex])];
-						if(matSpecs->flaming && collisionSpecs->flammable)
+						const Reaction &reaction = reactions[slot];
+						Uint8 roll = reaction.outcomes[0].chance >= 100 ? 1 : preGenRandRange(1, 100);
+						const ReactionOutcome *outcome = nullptr;
+						for(int m = 0; m < reaction.outcomeCount && !outcome; ++m)
 						{
-							setCell(newIndex, Material::FIRE);
-							break;
-						}
-						if(matSpecs->melting && collisionSpecs->meltable)
-						{
-							setCell(newIndex, Material::LAVA);
-							break;
+							if(roll <= reaction.outcomes[m].chance) { outcome = &reaction.outcomes[m]; }
+							else { roll -= reaction.outcomes[m].chance; }
 						}
-						if(computeBuffer[index] == Material::WATER)
+						if(outcome)
 						{
-							if(collisionSpecs->flaming || collisionSpecs->melting)
+							Profiler::ScopedTimer timer(profiler, Profiler::Timer::REACTIONS);
+							if(profiler && profiler->isEnabled()) { profiler->addReaction(static_cast<Uint8>(computeBuffer[_index].material), static_cast<Uint8>(computeBuffer[newIndex].material)); }
+							if(outcome->self != Material::NO_MATERIAL)
 							{
-								setCell(index, Material::STEAM);
+								setCell(_index, outcome->self, _rng);
 								destroyed = true;
-
-								if(computeBuffer[newIndex] == Material::LAVA && preGenRandRange(0, 1) == 0) 
-								{ 
-									setCell(newIndex, Material::GRAVEL); 
-								}
-								else
-								{
-									setCell(newIndex, Material::EMPTY);
-								}
-
-								break;
 							}
-						}
-						if(!collisionSpecs->solid && 
-							(collisionSpecs->density < matSpecs->density ||
-							collisionSpecs->density > matSpecs->density && direction < Direction::EAST))
-						{
-							lastIndex = newIndex;
+							if(outcome->other != Material::NO_MATERIAL) { setCell(newIndex, outcome->other, _rng); }
 							break;
 						}
+					}
+					const MaterialSpecs *collisionSpecs = &allSpecs[static_cast<int>(computeBuffer[newIndex].material)];
+					if(!(collisionSpecs->flags & FLAG_SOLID) && 
+						(collisionSpecs->density < matSpecs->density ||
+						collisionSpecs->density > matSpecs->density && direction < Direction::EAST))
+					{
+						lastIndex = newIndex;
 						break;
 					}
-					lastIndex = newIndex;
-				}
-				if(lastIndex != index && !destroyed)
-				{
-					swapCell(index, lastIndex);
-					moved = true;
 					break;
 				}
-				if(++directionIndex >= matSpecs->behaviorCounts[j]) { directionIndex = 0; }
+				lastIndex = newIndex;
+			}
+			if(lastIndex != _index && !destroyed)
+			{
+				swapCell(_index, lastIndex);
+				moved = true;
+				break;
 			}
+			if(++directionIndex >= behavior->counts[j]) { directionIndex = 0; }
 		}
-		//Creates a nice visual effect by mixing non-solids if they cannot move normally
-		if(!moved && !matSpecs->solid)
+	}
+	//Creates a nice visual effect by mixing non-solids if they cannot move normally
+	if(Mixes && !moved)
+	{
+		Uint8 direction = preGenRandRange(0, static_cast<int>(Direction::TOTAL_DIRECTIONS) - 1);
+		for(int j = 0; j < static_cast<int>(Direction::TOTAL_DIRECTIONS); ++j)
 		{
-			Uint8 direction = preGenRandRange(0, static_cast<int>(Direction::TOTAL_DIRECTIONS) - 1);
-			for(int j = 0; j < static_cast<int>(Direction::TOTAL_DIRECTIONS); ++j)
+			Uint32 location = getRelative(_index, static_cast<Direction>(direction));
+			Material buffMat = computeBuffer[location].material;
+			const MaterialSpecs &buffSpecs = allSpecs[static_cast<int>(buffMat)];
+			if(!(buffSpecs.flags & FLAG_SOLID) && buffSpecs.density == matSpecs->density)
 			{
-				Uint32 location = getRelative(index, static_cast<Direction>(direction));
-				if(location == -1) { continue; }
-				Material buffMat = computeBuffer[location];
-				if(!allSpecs[static_cast<int>(buffMat)].solid && allSpecs[static_cast<int>(buffMat)].density == matSpecs->density)
-				{
-					swapCell(index, location);
-					break;
-				}
-				if(direction >= static_cast<int>(Direction::TOTAL_DIRECTIONS)) { direction = 0; }
+				swapCell(_index, location);
+				break;
 			}
+			if(direction >= static_cast<int>(Direction::TOTAL_DIRECTIONS)) { direction = 0; }
 		}
 	}
-	delete[] randBatch;
 }
 
-void Simulation::reset(Material _mat, const SDL_Color *_col)
+//Fills every cell with one material. Shades come from a hash of the index so that resetting does not consume randomness
+void Simulation::reset(Material _mat)
 {
-	memset(computeBuffer, static_cast<int>(_mat), size * sizeof(Uint8));
-	memset(drawBuffer, SDL_MapRGBA(pixelFormat, _col->r, _col->g, _col->b, _col->a), size * sizeof(Uint32));
+	for(int i = 0; i < paddedSize; ++i)
+	{
+		Sint32 x = i % stride;
+		Sint32 y = i / stride;
+		bool border = x == 0 || y == 0 || x == stride - 1 || y == height + 1;
+		computeBuffer[i] = {border ? Material::WALL : _mat, static_cast<Uint8>(mix32(i) % PALETTE_SIZE), generation};
+	}
+	for(int i = 0; i < chunkCount; ++i)
+	{
+		renderRects[i] = {0, 0, CHUNK_SIZE - 1, CHUNK_SIZE - 1};
+		heatStale[i] = true;
+	}
+	memset(heat, 0, heatWide * heatHigh * sizeof(float));
+	memset(nextHeat, 0, heatWide * heatHigh * sizeof(float));
+	memset(heatSources, 0, heatWide * heatHigh * sizeof(float));
+	memset(heatPulls, 0, heatWide * heatHigh * sizeof(float));
+	wakeArea(0, 0, width - 1, height - 1);
 }
 
-//Draws a thick line between two points. This is used so that when the cursor is moved quickly it makes a contiguous line instead of dots
-void Simulation::setCellLine(SDL_Point _start, SDL_Point _end, Uint16 _rad, Material _mat)
+//Draws a thick line between two points. This is used so that when the cursor is moved quickly it makes a contiguous line instead of dots.
+//The brush swept from one point to the other is convex, so each of its rows is a single span. A span is bounded by the brush
+//at either end and by the edges its outline traces between them, and every cell in it is written exactly once.
+//Materials that were not loaded from the file are ignored, since they have no specs or colors
+void Simulation::setCellLine(SDL_Point _start, SDL_Point _end, Uint16 _rad, Material _mat, Brush _brush)
 {
-	setCellRadius(_start, _rad, _mat);
-	if(!(_start.x == _end.x && _start.y == _end.y))
+	if(static_cast<Uint8>(_mat) >= materialCount) { return; }
+	Sint32 rad = _rad;
+	float dx = static_cast<float>(_end.x - _start.x);
+	float dy = static_cast<float>(_end.y - _start.y);
+	float length = sqrtf(dx * dx + dy * dy);
+
+	//A swept square is traced by its corners, and a swept circle by the two points at right angles to the line
+	float edgeX[4], edgeY[4];
+	int edgeCount = 0;
+	if(_brush == Brush::SQUARE)
 	{
-		setCellRadius(_end, _rad, _mat);
-		float angle = -atan2(_end.x - _start.x, _end.y - _start.y);
-		Sint32 tanDiffX = round(cos(angle) * _rad);
-		Sint32 tanDiffY = round(sin(angle) * _rad);
-		Sint32 *tanLineX, *tanLineY, *mainLineX, *mainLineY;
-		Uint16 tanLen = Graphics::bresenhams(_start.x + tanDiffX, _start.y + tanDiffY, _start.x - tanDiffX, _start.y - tanDiffY, tanLineX, tanLineY, true);
-		Uint16 mainLen = Graphics::bresenhams(_start.x + tanDiffX, _start.y + tanDiffY, _end.x + tanDiffX, _end.y + tanDiffY, mainLineX, mainLineY, false);
-		for(int i = 0; i < tanLen; ++i)
+		const float cornerX[] = {-1.0f, 1.0f, 1.0f, -1.0f};
+		const float cornerY[] = {-1.0f, -1.0f, 1.0f, 1.0f};
+		for(int i = 0; i < 4; ++i)
 		{
-			for(int j = 0; j < mainLen; ++j)
-			{
-				Sint32 diffX = (_start.x + tanDiffX) - tanLineX[i];
-				Sint32 diffY = (_start.y + tanDiffY) - tanLineY[i];
-				setCellIfValid(mainLineX[j] - diffX, mainLineY[j] - diffY, _mat);
-			}
+			edgeX[edgeCount] = cornerX[i] * rad;
+			edgeY[edgeCount++] = cornerY[i] * rad;
 		}
-		delete[] tanLineX;
-		delete[] tanLineY;
-		delete[] mainLineX;
-		delete[] mainLineY;
 	}
-}
-
-//Sees if a cell relative to a given index is a valid spot to move
-Uint32 Simulation::getRelative(Uint32 _index, Direction _dir) const
-{
-	Sint8 horizontal = 0;
-	horizontal += _dir == Direction::NORTH_EAST || _dir == Direction::EAST || _dir == Direction::SOUTH_EAST;
-	horizontal -= _dir == Direction::SOUTH_WEST || _dir == Direction::WEST || _dir == Direction::NORTH_WEST;
-	Sint8 vertical = 0;
-	vertical += _dir == Direction::SOUTH_EAST || _dir == Direction::SOUTH || _dir == Direction::SOUTH_WEST;
-	vertical -= _dir == Direction::NORTH_WEST || _dir == Direction::NORTH || _dir == Direction::NORTH_EAST;
-	
-	if(horizontal != 0)
+	else if(length > 0.0f)
 	{
-		Uint32 original = _index;
-		_index += horizontal;
-		if(_index / width != original / width) { return -1; }
+		edgeX[edgeCount] = -dy / length * rad;
+		edgeY[edgeCount++] = dx / length * rad;
+		edgeX[edgeCount] = dy / length * rad;
+		edgeY[edgeCount++] = -dx / length * rad;
 	}
-	if(vertical != 0)
+
+	const SDL_Point ends[] = {_start, _end};
+	Sint32 minY = std::max(std::min(_start.y, _end.y) - rad, 0);
+	Sint32 maxY = std::min<Sint32>(std::max(_start.y, _end.y) + rad, height - 1);
+	for(Sint32 y = minY; y <= maxY; ++y)
 	{
-		_index += vertical * width;
-		if(_index >= size || _index < 0) { return -1; }
+		float left = static_cast<float>(width);
+		float right = -1.0f;
+		for(const SDL_Point &end : ends)
+		{
+			Sint32 rowOffset = y - end.y;
+			if(abs(rowOffset) > rad) { continue; }
+			float half = _brush == Brush::SQUARE ? rad : sqrtf(static_cast<float>(rad * rad - rowOffset * rowOffset));
+			left = std::min(left, end.x - half);
+			right = std::max(right, end.x + half);
+		}
+		//Horizontal edges are skipped, since their ends already lie on the brush at either end of the line
+		for(int i = 0; i < edgeCount; ++i)
+		{
+			float startY = _start.y + edgeY[i];
+			float endY = _end.y + edgeY[i];
+			if(startY == endY || y < std::min(startY, endY) || y > std::max(startY, endY)) { continue; }
+			float x = _start.x + edgeX[i] + dx * (y - startY) / (endY - startY);
+			left = std::min(left, x);
+			right = std::max(right, x);
+		}
+		fillSpan(y, static_cast<Sint32>(ceilf(left)), static_cast<Sint32>(floorf(right)), _mat, _brush == Brush::SPRAY);
 	}
-	return _index;
 }
 
 //Converts a hsv value to rgb. We smoothly interpolate colors using hsv, then convert to rgb so SDL can use them
@@ -325,70 +1056,174 @@ SDL_Color Simulation::HsvToRgb(const HsvColor *_hsv) const
 	return rgba;
 }
 
-//Sets a cell to a material. Interpolates between colors to add visual variation
-void Simulation::setCell(Uint32 _index, Material _mat)
+//Samples every material's colour range. A fixed generator is used so that colours do not depend on the seed
+void Simulation::bakePalettes()
 {
-	computeBuffer[_index] = _mat;
+	Xorshift128 rng = {123456789, 362436069, 521288629, 88675123};
+	auto randLerp = [&](Uint8 min, Uint8 max) { return static_cast<Uint8>(min + rng() % (max - min + 1)); };
+	for(int i = 0; i < PALETTE_SIZE; ++i) { colorPalettes[static_cast<int>(Material::EMPTY)][i] = EMPTY_COLOR; }
+	for(int i = 1; i < MAX_MATERIALS; ++i)
+	{
+		const MaterialInfo *specs = &allInfo[i];
+		for(int j = 0; j < PALETTE_SIZE; ++j)
+		{
+			HsvColor interpolatedHsv = {
+				randLerp(specs->minColor.h, specs->maxColor.h),
+				randLerp(specs->minColor.s, specs->maxColor.s),
+				randLerp(specs->minColor.v, specs->maxColor.v)
+			};
+			colorPalettes[i][j] = HsvToRgb(&interpolatedHsv);
+		}
+	}
+	mapPalettes();
+}
 
-	if(_mat != Material::EMPTY)
+//Converts the palettes to the current pixel format
+void Simulation::mapPalettes()
+{
+	for(int i = 0; i < MAX_MATERIALS; ++i)
 	{
-		auto randLerp = [&](Uint8 min, Uint8 max) { return static_cast<Uint8>(min + round((max - min) * doubleDist(mt))); };
-		const MaterialSpecs *specs = &allSpecs[static_cast<int>(_mat)];
-		HsvColor interpolatedHsv = {
-			randLerp(specs->minColor.h, specs->maxColor.h),
-			randLerp(specs->minColor.s, specs->maxColor.s),
-			randLerp(specs->minColor.v, specs->maxColor.v)
-		};
-		SDL_Color rgba = HsvToRgb(&interpolatedHsv);
-		drawBuffer[_index] = SDL_MapRGBA(pixelFormat, rgba.r, rgba.g, rgba.b, rgba.a);
+		for(int j = 0; j < PALETTE_SIZE; ++j)
+		{
+			const SDL_Color &col = colorPalettes[i][j];
+			pixelPalettes[i][j] = SDL_MapRGBA(pixelFormat, col.r, col.g, col.b, col.a);
+		}
 	}
-	else
+}
+
+//Sets a cell to a material. Picks a random colour from the material's palette to add visual variation
+void Simulation::setCell(Uint32 _index, Material _mat, Xorshift128 &_rng)
+{
+	computeBuffer[_index] = {_mat, static_cast<Uint8>(_rng() % PALETTE_SIZE), generation};
+	markChanged(_index);
+}
+
+//Fills a run of cells in a row for user input, clipped to the grid. Drawing only fills empty cells, while erasing clears anything.
+//The run is redrawn and woken as a whole rather than cell by cell. Input is applied between ticks, so cells are written without locks
+void Simulation::fillSpan(Sint32 _y, Sint32 _minX, Sint32 _maxX, Material _mat, bool _spray)
+{
+	_minX = std::max(_minX, 0);
+	_maxX = std::min<Sint32>(_maxX, width - 1);
+	if(_minX > _maxX) { return; }
+
+	Cell *row = computeBuffer + getIndex(0, _y);
+	for(Sint32 x = _minX; x <= _maxX; ++x)
 	{
-		drawBuffer[_index] = SDL_MapRGBA(pixelFormat, EMPTY_COLOR.r, EMPTY_COLOR.g, EMPTY_COLOR.b, EMPTY_COLOR.a);
+		if(_spray && mainRng() % SPRAY_DENSITY != 0) { continue; }
+		if(_mat != Material::EMPTY && row[x].material != Material::EMPTY) { continue; }
+		row[x] = {_mat, static_cast<Uint8>(mainRng() % PALETTE_SIZE), generation};
 	}
 
-	updatedCells->set(_index);
+	markAreaChanged(_minX, _y, _maxX, _y);
 }
 
-void Simulation::setCellIfValid(Sint32 _x, Sint32 _y, Material _mat)
+void Simulation::swapCell(Uint32 _current, Uint32 _next)
 {
-	Uint32 index = _x + _y * width;
-	if(_y >= 0 && _y < height && _x >= 0 && _x < width && (_mat == Material::EMPTY || computeBuffer[index] == Material::EMPTY))
+	//The shade moves with the material, so a cell keeps its colour as it moves
+	Cell temp = computeBuffer[_next];
+	computeBuffer[_next] = computeBuffer[_current];
+	computeBuffer[_current] = temp;
+	computeBuffer[_next].generation = generation;
+	markChanged(_current);
+	markChanged(_next);
+}
+
+//Records a changed cell. Its chunk has to be redrawn, and its neighbours have to be updated on the next tick
+void Simulation::markChanged(Uint32 _index)
+{
+	Sint32 x = _index % stride - 1;
+	Sint32 y = _index / stride - 1;
+	Uint32 chunk = (y / CHUNK_SIZE) * chunksWide + x / CHUNK_SIZE;
+	Sint16 localX = x % CHUNK_SIZE;
+	Sint16 localY = y % CHUNK_SIZE;
+	DirtyRect &rect = renderRects[chunk];
+	if(threadCount > 1) { SDL_AtomicLock(&rectLocks[chunk]); }
+	rect = {std::min(rect.minX, localX), std::min(rect.minY, localY), std::max(rect.maxX, localX), std::max(rect.maxY, localY)};
+	if(threadCount > 1) { SDL_AtomicUnlock(&rectLocks[chunk]); }
+	wakeArea(x - 1, y - 1, x + 1, y + 1);
+}
+
+//Records an inclusive area of changed cells in one go. Every chunk it overlaps redraws its part of it, and the cells around it
+//are updated on the next tick
+void Simulation::markAreaChanged(Sint32 _minX, Sint32 _minY, Sint32 _maxX, Sint32 _maxY)
+{
+	for(Sint32 cy = _minY / CHUNK_SIZE; cy <= _maxY / CHUNK_SIZE; ++cy)
 	{
-		setCell(index, _mat);
+		for(Sint32 cx = _minX / CHUNK_SIZE; cx <= _maxX / CHUNK_SIZE; ++cx)
+		{
+			Uint32 chunk = cy * chunksWide + cx;
+			DirtyRect &rect = renderRects[chunk];
+			Sint16 minX = std::max<Sint32>(_minX - cx * CHUNK_SIZE, 0);
+			Sint16 minY = std::max<Sint32>(_minY - cy * CHUNK_SIZE, 0);
+			Sint16 maxX = std::min<Sint32>(_maxX - cx * CHUNK_SIZE, CHUNK_SIZE - 1);
+			Sint16 maxY = std::min<Sint32>(_maxY - cy * CHUNK_SIZE, CHUNK_SIZE - 1);
+			if(threadCount > 1) { SDL_AtomicLock(&rectLocks[chunk]); }
+			rect = {std::min(rect.minX, minX), std::min(rect.minY, minY), std::max(rect.maxX, maxX), std::max(rect.maxY, maxY)};
+			if(threadCount > 1) { SDL_AtomicUnlock(&rectLocks[chunk]); }
+		}
 	}
+	wakeArea(_minX - 1, _minY - 1, _maxX + 1, _maxY + 1);
 }
 
-//Sets a circle of cells by radius for user input
-void Simulation::setCellRadius(SDL_Point _pos, Uint16 _rad, Material _mat)
+//Wakes the cells around an index so that they are updated on the next tick
+void Simulation::wakeCell(Uint32 _index)
 {
-	for(int i = 0; i < _rad * 2; ++i)
+	Sint32 x = _index % stride - 1;
+	Sint32 y = _index / stride - 1;
+	wakeArea(x - 1, y - 1, x + 1, y + 1);
+}
+
+//Expands the next dirty rect of every chunk that overlaps an inclusive area of cells
+void Simulation::wakeArea(Sint32 _minX, Sint32 _minY, Sint32 _maxX, Sint32 _maxY)
+{
+	_minX = std::max(_minX, 0);
+	_minY = std::max(_minY, 0);
+	_maxX = std::min<Sint32>(_maxX, width - 1);
+	_maxY = std::min<Sint32>(_maxY, height - 1);
+	for(Sint32 cy = _minY / CHUNK_SIZE; cy <= _maxY / CHUNK_SIZE; ++cy)
 	{
-		Uint16 slice = sqrt(pow(_rad, 2) - pow(abs(_rad - i), 2));
-		for(int j = -slice; j < slice; ++j)
+		for(Sint32 cx = _minX / CHUNK_SIZE; cx <= _maxX / CHUNK_SIZE; ++cx)
 		{
-			Sint32 x = _pos.x + j;
-			Sint32 y = _pos.y - _rad + i;
-			setCellIfValid(x, y, _mat);
+			Uint32 chunk = cy * chunksWide + cx;
+			DirtyRect &rect = nextRects[chunk];
+			//Up to four workers can wake the same chunk from its corners
+			if(threadCount > 1) { SDL_AtomicLock(&rectLocks[chunk]); }
+			rect.minX = std::min<Sint16>(rect.minX, std::max(_minX - cx * CHUNK_SIZE, 0));
+			rect.minY = std::min<Sint16>(rect.minY, std::max(_minY - cy * CHUNK_SIZE, 0));
+			rect.maxX = std::max<Sint16>(rect.maxX, std::min(_maxX - cx * CHUNK_SIZE, CHUNK_SIZE - 1));
+			rect.maxY = std::max<Sint16>(rect.maxY, std::min(_maxY - cy * CHUNK_SIZE, CHUNK_SIZE - 1));
+			if(threadCount > 1) { SDL_AtomicUnlock(&rectLocks[chunk]); }
 		}
 	}
 }
 
-void Simulation::swapCell(Uint32 _current, Uint32 _next)
+//Scrambles the bits of a number so that similar inputs give unrelated outputs
+Uint32 Simulation::mix32(Uint32 _x)
 {
-	Material tempMat = computeBuffer[_next];
-	computeBuffer[_next] = computeBuffer[_current];
-	computeBuffer[_current] = tempMat;
-	Uint32 tempCol = drawBuffer[_next];
-	drawBuffer[_next] = drawBuffer[_current];
-	drawBuffer[_current] = tempCol;
-	updatedCells->set(_next);
+	_x ^= _x >> 16;
+	_x *= 0x85EBCA6B;
+	_x ^= _x >> 13;
+	_x *= 0xC2B2AE35;
+	_x ^= _x >> 16;
+	return _x;
+}
+
+//A stateless counter-based generator that gives the numbers for a run of consecutive cells. No iteration depends on
+//another, so the compiler can turn the loop into vector instructions
+void Simulation::fillRandom(Uint32 *_out, Uint32 _firstIndex, Uint32 _count, Uint32 _key)
+{
+	for(Uint32 i = 0; i < _count; ++i) { _out[i] = mix32((_firstIndex + i) * 0x9E3779B1 ^ _key); }
+}
+
+Simulation::Xorshift128 Simulation::seedXorshift()
+{
+	return {static_cast<Uint32>(xorSeedDist(mt)), static_cast<Uint32>(xorSeedDist(mt)),
+		static_cast<Uint32>(xorSeedDist(mt)), static_cast<Uint32>(xorSeedDist(mt))};
 }
 
 //A highly efficient but imperfect random number generation algorithm
-Uint32 Simulation::xorshift128()
+Uint32 Simulation::Xorshift128::operator()()
 {
-	static Uint32 a = xorSeedDist(mt), b = xorSeedDist(mt), c = xorSeedDist(mt), d = xorSeedDist(mt);
 	Uint32 t = d;
 	Uint32 s = a;
 
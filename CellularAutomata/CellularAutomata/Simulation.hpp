@@ -1,42 +1,65 @@
 #pragma once
 
 #include "SDL.h" 
+#include "Profiler.hpp"
+#include "Arena.hpp"
 
-#include <boost/dynamic_bitset.hpp>
 #include <random>
 #include <string>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
 
 const SDL_Color EMPTY_COLOR = {0, 0, 0, 255};
 
+const Uint8 MAX_MATERIALS = 64;
 const Uint8 MAX_BEHAVIOR_SETS = 4;
 const Uint8 MAX_BEHAVIORS_PER_SET = 8;
-const Uint16 RAND_BATCH_SIZE = 4000;
+const Uint8 MAX_REACTION_OUTCOMES = 4;
+const Uint8 PALETTE_SIZE = 64;
+const Uint8 CHUNK_SIZE = 32;
+const Uint8 CHUNK_PHASES = 4;
+//Chunks updated in the same phase have one chunk between them, so cells from either side only stay out of each other's way
+//while no cell moves past half a chunk in one tick. Faster materials are slowed to this when they are loaded
+const Uint8 MAX_SPEED = CHUNK_SIZE / 2 - 1;
+const Uint8 SPRAY_DENSITY = 12;
+const Uint8 PRESSURE_INTERVAL = 4;
+const Uint16 PRESSURE_MAX_MOVES = 256;
+const Uint8 HEAT_BLOCK = 4;
+const Uint8 HEAT_INTERVAL = 2;
+const Uint8 HEAT_TRANSITION_CHANCE = 4;
+const float HEAT_DIFFUSION = 0.25f;
+const float HEAT_EXCHANGE = 1.0f;
+const float HEAT_LOSS = 0.002f;
 
 const std::string MATERIAL_FILE_PATH = "../../Materials.json";
 
 class Simulation
 {
+	friend class Snapshot;
+
 public:
+	//Only empty and the border walls are built in. Every other material is numbered from one in the order it appears
+	//in the material file, and is found by name with findMaterial
 	enum class Material : Uint8
 	{
 		EMPTY = 0,
-		ROCK,
-		SAND,
-		WATER,
-		FIRE,
-		LAVA,
-		OIL,
-		ICE,
-		GAS,
-		STEAM,
-		GRAVEL,
-		WOOD,
-		PLASMA,
-		TOTAL_MATERIALS,
+		WALL = MAX_MATERIALS - 1, //Lines the border of the grid and is never drawn
 		NO_MATERIAL = 255
 	};
 
+	//Properties of a material that are checked as bits of one byte of its specs
+	enum MaterialFlag : Uint8
+	{
+		FLAG_SOLID = 1 << 0,
+		FLAG_PRESSURISED = 1 << 1,
+		FLAG_FALLS = 1 << 2, //Never dies and only tries to move straight down first, so it can be dropped a column at a time
+		FLAG_REACTS = 1 << 3
+	};
+
 	enum class Direction : Uint8
 	{
 		NORTH_WEST = 0,
@@ -51,53 +74,227 @@ public:
 		NO_DIRECTION = 255,
 	};
 
+	//The order cells are visited in within a chunk. Shuffled visits a fixed random permutation,
+	//while sweep walks rows from the bottom up and stays local in memory
+	enum class Traversal : Uint8
+	{
+		SHUFFLED = 0,
+		SWEEP
+	};
+
+	//Shapes a stroke can be drawn with. Spray covers the same area as round, but only fills one in SPRAY_DENSITY cells
+	enum class Brush : Uint8
+	{
+		ROUND = 0,
+		SQUARE,
+		SPRAY,
+		TOTAL_BRUSHES
+	};
+
 	struct HsvColor { Uint8 h, s, v; };
 
+	//A highly efficient but imperfect random number generator. Every chunk gets its own on each tick
+	struct Xorshift128
+	{
+		Uint32 a, b, c, d;
+		Uint32 operator()();
+	};
+
+	//All a cell stores is its material, an index into that material's palette and the generation it was last moved or set in
+	struct Cell
+	{
+		Material material;
+		Uint8 shade;
+		Uint8 generation;
+	};
+
+	//An inclusive area of cells that may change on the next tick. A chunk with an empty rect is asleep
+	struct DirtyRect { Sint16 minX, minY, maxX, maxY; };
+
+	//What a cell becomes once the heat around it passes a threshold. A threshold at the end of the range never passes
+	struct HeatTransition
+	{
+		Material into;
+		Sint8 threshold;
+	};
+
+	//A material is split over tables by how often it is read. Its specs are read for every cell that moves and every cell
+	//it runs into, so they are kept to six bytes and the whole table fits in a few cache lines
 	struct MaterialSpecs
+	{
+		Uint8 flags, density, minSpeed, maxSpeed, deathChance, behaviorSetCount;
+	};
+
+	//Read once per update of a moving cell
+	struct MaterialBehavior
+	{
+		Uint8 counts[MAX_BEHAVIOR_SETS];
+		Direction directions[MAX_BEHAVIOR_SETS][MAX_BEHAVIORS_PER_SET];
+	};
+
+	//Read by the heat step. The pull is how hard a cell draws its block toward its temperature, and the source is the heat
+	//that pull brings in
+	struct MaterialHeat
+	{
+		float pull, source;
+		HeatTransition heated, cooled;
+	};
+
+	//Only read when the material file is loaded and by the interface
+	struct MaterialInfo
 	{
 		std::string name;
 		HsvColor minColor, maxColor;
-		Uint8 minSpeed, maxSpeed, density, deathChance;
 		Sint8 temperature;
-		bool solid, flaming, flammable, melting, meltable;
-		Uint8 behaviorSetCount, behaviorCounts[MAX_BEHAVIOR_SETS];
-		Direction behavior[MAX_BEHAVIOR_SETS][MAX_BEHAVIORS_PER_SET];
 	};
 
-	Simulation(int _width, int _height, Uint32 _pixelFormat);
+	//What a moving cell and the cell it runs into become. NO_MATERIAL leaves a cell as it is
+	struct ReactionOutcome
+	{
+		Material self, other;
+		Uint8 chance;
+	};
+
+	//Every pair of materials has a list of outcomes whose chances are percentages. When none of them is rolled, the cells collide normally
+	struct Reaction
+	{
+		Uint8 outcomeCount;
+		ReactionOutcome outcomes[MAX_REACTION_OUTCOMES];
+	};
+
+	Simulation(int _width, int _height, Uint32 _pixelFormat, Uint8 _threadCount = 1);
 	~Simulation();
 
-	Uint32 *getDrawBuffer() const { return drawBuffer; };
+	Uint16 getWidth() const { return width; };
+	Uint16 getHeight() const { return height; };
+	Uint32 getSeed() const { return seed; };
+	Uint32 getTick() const { return tick; };
+	Traversal getTraversal() const { return traversal; };
+	Uint64 getChecksum() const;
 	std::string getMaterialString() const;
+	Uint8 getMaterialCount() const { return materialCount; };
+	const std::string &getMaterialName(Material _mat) const { return allInfo[static_cast<int>(_mat)].name; };
+	Material findMaterial(const std::string &_name) const;
 
 	void update();
-	void reset(Material _mat = Material::EMPTY, const SDL_Color *_col = &EMPTY_COLOR);
-	void setPixelFormat(Uint32 _pixelFormat) { pixelFormat = SDL_AllocFormat(_pixelFormat); };
-	void setCellLine(SDL_Point _start, SDL_Point _end, Uint16 _rad, Material _mat);
+	const std::vector<SDL_Rect> &collectDirtyRegions();
+	void renderCells(const SDL_Rect *_area, const Cell *_cells, int _cellPitch, Uint32 *_pixels, int _pitch) const;
+	void readCells(const SDL_Rect *_area, Cell *_cells, int _pitch) const;
+	void writeCells(const SDL_Rect *_area, const Cell *_cells, int _pitch);
+	void reset(Material _mat = Material::EMPTY);
+	void setPixelFormat(Uint32 _pixelFormat);
+	void setThreadCount(Uint8 _threadCount);
+	void setSeed(Uint32 _seed);
+	void setTraversal(Traversal _traversal) { traversal = _traversal; };
+	void setProfiler(Profiler *_profiler) { profiler = _profiler; };
+	void setCellLine(SDL_Point _start, SDL_Point _end, Uint16 _rad, Material _mat, Brush _brush = Brush::ROUND);
 
 private:
-	Uint16 width, height;
-	Uint64 size;
+	Uint16 width, height, stride;
+	Uint64 size, paddedSize;
+	Sint32 neighbourOffsets[static_cast<int>(Direction::TOTAL_DIRECTIONS)];
 	SDL_PixelFormat *pixelFormat;
 	
+	Uint32 seed, tick;
 	std::mt19937 mt;
-	std::uniform_real_distribution<double> doubleDist;
 	std::uniform_int_distribution<int> xorSeedDist;
+	Xorshift128 mainRng;
+
+	//Every buffer below that grows with the world is a slice of this arena
+	Arena arena;
+	Cell *computeBuffer;
+	Uint16 *iterationNoise;
+	Uint8 generation;
+	Traversal traversal;
+	Profiler *profiler;
+
+	Uint16 chunksWide, chunksHigh;
+	Uint32 chunkCount;
+	DirtyRect *activeRects;
+	DirtyRect *nextRects;
+	DirtyRect *renderRects;
+	SDL_SpinLock *rectLocks;
+	std::vector<SDL_Rect> dirtyRegions;
+
+	//Bodies of pressurised liquid are found by flood fill. A cell belongs to the current pass when its mark equals the stamp.
+	//The lists of one fill are carved from the scratch arena, which is reset for every body
+	Uint32 *pressureMarks;
+	Uint32 pressureStamp;
+	Arena scratch;
 
-	Material *computeBuffer;
-	Uint32 *drawBuffer;
-	Uint16 *batchNoise;
-	Uint32 *iterationNoise;
-	boost::dynamic_bitset<Uint64> *updatedCells;
+	//Heat is kept for blocks of HEAT_BLOCK by HEAT_BLOCK cells, with a border of blocks held at zero. Every cell pulls its block
+	//toward its own temperature. The pulls are only summed again for chunks that may have changed since the last heat step
+	Uint16 heatWide, heatHigh;
+	float *heat;
+	float *nextHeat;
+	float *heatSources;
+	float *heatPulls;
+	bool *heatStale;
+	float heatedMin, cooledMax;
 
-	MaterialSpecs allSpecs[static_cast<int>(Material::TOTAL_MATERIALS)];
+	//Chunks are updated in four phases of a checkerboard pattern, so that no two chunks updated at the same time
+	//are close enough to touch the same cells. Workers pull chunks of the current phase from a shared counter
+	Uint8 threadCount;
+	std::thread *workers;
+	std::mutex poolMutex;
+	std::condition_variable poolWake, poolDone;
+	Uint32 poolGeneration;
+	Uint8 poolPending;
+	bool poolStopping;
+	Uint32 *phaseChunks;
+	Uint32 phaseChunkCount;
+	std::atomic<Uint32> phaseNext;
+	bool droppingColumns;
 
-	Uint32 getRelative(Uint32 _index, Direction _dir) const;
+	//Materials below the count are empty and the ones loaded from the file. The rest of the tables is unused apart from the walls
+	Uint8 materialCount;
+	MaterialSpecs allSpecs[MAX_MATERIALS];
+	MaterialBehavior allBehaviors[MAX_MATERIALS];
+	MaterialHeat allHeat[MAX_MATERIALS];
+	MaterialInfo allInfo[MAX_MATERIALS];
+
+	//Each pair of materials has a byte that is zero when they do not react, and otherwise indexes their list of outcomes
+	Uint8 reactionSlots[MAX_MATERIALS][MAX_MATERIALS];
+	std::vector<Reaction> reactions;
+
+	//Every material is updated by a kernel picked once its specs are loaded. Kernels leave out the checks
+	//for properties the material does not have, and anything unusual uses the fully checked interpreter
+	typedef void (Simulation::*CellKernel)(Uint32 _index, Uint32 _randi, Xorshift128 &_rng);
+	CellKernel kernels[MAX_MATERIALS];
+
+	//Each material's colour range is sampled once into a small palette, so that spawning a cell only picks an entry
+	SDL_Color colorPalettes[MAX_MATERIALS][PALETTE_SIZE];
+	Uint32 pixelPalettes[MAX_MATERIALS][PALETTE_SIZE];
+
+	Uint32 getIndex(Sint32 _x, Sint32 _y) const { return (_y + 1) * stride + _x + 1; };
+	Uint32 getRelative(Uint32 _index, Direction _dir) const { return _index + neighbourOffsets[static_cast<int>(_dir)]; };
 	SDL_Color HsvToRgb(const HsvColor *_hsv) const;
+	void bakePalettes();
+	void mapPalettes();
+
+	void runPool();
+	void runPhase();
+	void workerLoop();
+	void stopWorkers();
+	void updateChunk(Uint32 _chunk);
+	void dropColumns(Uint32 _chunkX);
+	void loadMaterials();
+	void selectKernels();
+	void levelLiquids();
+	void levelBody(Uint32 _seed);
+	void updateHeat();
+	void sumHeatSources(Uint32 _chunk);
+	template<bool Mixes, bool Dies, bool Reacts> void updateCell(Uint32 _index, Uint32 _randi, Xorshift128 &_rng);
+	void updateStatic(Uint32, Uint32, Xorshift128 &) {}
+	void markChanged(Uint32 _index);
+	void markAreaChanged(Sint32 _minX, Sint32 _minY, Sint32 _maxX, Sint32 _maxY);
+	void wakeCell(Uint32 _index);
+	void wakeArea(Sint32 _minX, Sint32 _minY, Sint32 _maxX, Sint32 _maxY);
 
-	void setCell(Uint32 _index, Material _mat);
-	void setCellIfValid(Sint32 _x, Sint32 _y, Material _mat);
-	void setCellRadius(SDL_Point _pos, Uint16 _rad, Material _mat);
+	void setCell(Uint32 _index, Material _mat, Xorshift128 &_rng);
+	void fillSpan(Sint32 _y, Sint32 _minX, Sint32 _maxX, Material _mat, bool _spray);
 	void swapCell(Uint32 _current, Uint32 _next);
-	Uint32 xorshift128();
+	Xorshift128 seedXorshift();
+	static Uint32 mix32(Uint32 _x);
+	static void fillRandom(Uint32 *_out, Uint32 _firstIndex, Uint32 _count, Uint32 _key);
 };
\ No newline at end of file
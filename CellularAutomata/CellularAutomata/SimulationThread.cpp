@@ -0,0 +1,167 @@
+#include "SimulationThread.hpp"
+#include "Snapshot.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+SimulationThread::SimulationThread(Simulation *_sim, World *_world, Recorder *_recorder, Uint32 _tickInterval, const std::string &_snapshotPath)
+{
+	sim = _sim;
+	world = _world;
+	recorder = _recorder;
+	tickInterval = _tickInterval;
+	snapshotPath = _snapshotPath;
+
+	for(int i = 0; i < FRAME_BUFFERS; ++i)
+	{
+		frames[i].cells = new Simulation::Cell[sim->getWidth() * sim->getHeight()]();
+	}
+	backFrame = 0;
+	readyFrame = 1;
+	frontFrame = 2;
+	readyFresh = false;
+
+	paused = false;
+	stopping = false;
+	ticksPerSecond = 0;
+	thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		stopping = true;
+	}
+	commandQueued.notify_one();
+	thread.join();
+	for(int i = 0; i < FRAME_BUFFERS; ++i) { delete[] frames[i].cells; }
+}
+
+void SimulationThread::pushCommand(const Command &_command)
+{
+	std::lock_guard<std::mutex> lock(commandMutex);
+	commands.push_back(_command);
+}
+
+//Takes the newest finished frame, or nullptr if nothing changed since the last one. The frame stays valid until the next call
+const SimulationThread::Frame *SimulationThread::acquireFrame()
+{
+	std::lock_guard<std::mutex> lock(frameMutex);
+	if(!readyFresh) { return nullptr; }
+	std::swap(frontFrame, readyFrame);
+	readyFresh = false;
+	return &frames[frontFrame];
+}
+
+void SimulationThread::run()
+{
+	auto nextTick = std::chrono::steady_clock::now();
+	auto secondStart = nextTick;
+	Uint32 ticks = 0;
+	while(!stopping)
+	{
+		applyCommands();
+		if(!paused)
+		{
+			sim->update();
+			++ticks;
+		}
+		publishFrame();
+
+		auto now = std::chrono::steady_clock::now();
+		if(now - secondStart >= std::chrono::seconds(1))
+		{
+			ticksPerSecond = ticks;
+			ticks = 0;
+			secondStart = now;
+		}
+
+		//A late tick does not make the following ones run faster to catch up, the simulation just slows down
+		nextTick += std::chrono::milliseconds(tickInterval);
+		if(nextTick < now) { nextTick = now; }
+		std::unique_lock<std::mutex> lock(commandMutex);
+		commandQueued.wait_until(lock, nextTick, [&] { return stopping.load(); });
+	}
+}
+
+//Input is applied between ticks, on this thread, so that a recording sees it on the tick it took effect
+void SimulationThread::applyCommands()
+{
+	std::vector<Command> queued;
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		queued.swap(commands);
+	}
+	for(const Command &command : queued)
+	{
+		switch(command.type)
+		{
+		case CommandType::STROKE:
+			if(recorder) { recorder->recordStroke(sim, command.start, command.end, command.radius, command.material, command.brush); }
+			sim->setCellLine(command.start, command.end, command.radius, command.material, command.brush);
+			break;
+
+		case CommandType::RESET:
+			if(recorder) { recorder->recordReset(sim, command.material); }
+			sim->reset(command.material);
+			break;
+
+		//Scrolling swaps cells in from regions the recording knows nothing about, so it is refused while recording
+		case CommandType::SCROLL:
+			if(world && !recorder) { world->scroll(command.start.x, command.start.y); }
+			break;
+
+		//Loading replaces the grid and the random state without leaving an event a replay could follow,
+		//so snapshots are neither saved nor loaded while recording
+		case CommandType::SAVE:
+			if(!recorder) { Snapshot::save(snapshotPath, sim); }
+			break;
+
+		case CommandType::LOAD:
+		{
+			if(recorder) { break; }
+			Snapshot snapshot;
+			if(snapshot.open(snapshotPath)) { snapshot.restore(sim); }
+			break;
+		}
+		}
+	}
+}
+
+//Copies every cell the back frame has missed into it, then makes it the ready frame. A ready frame the renderer
+//never picked up passes its regions on, so the renderer still uploads every change
+void SimulationThread::publishFrame()
+{
+	const std::vector<SDL_Rect> &dirty = sim->collectDirtyRegions();
+	if(dirty.empty()) { return; }
+	for(int i = 0; i < FRAME_BUFFERS; ++i) { addRegions(pendingRegions[i], dirty); }
+
+	Frame &frame = frames[backFrame];
+	Uint16 width = sim->getWidth();
+	for(const SDL_Rect &region : pendingRegions[backFrame])
+	{
+		sim->readCells(&region, frame.cells + region.y * width + region.x, width);
+	}
+	pendingRegions[backFrame].clear();
+	frame.regions.clear();
+	addRegions(frame.regions, dirty);
+
+	std::lock_guard<std::mutex> lock(frameMutex);
+	if(readyFresh) { addRegions(frame.regions, frames[readyFrame].regions); }
+	std::swap(backFrame, readyFrame);
+	readyFresh = true;
+}
+
+//Appends regions to a list. A list that grows too long is replaced by the whole simulation
+void SimulationThread::addRegions(std::vector<SDL_Rect> &_list, const std::vector<SDL_Rect> &_regions) const
+{
+	SDL_Rect whole = {0, 0, sim->getWidth(), sim->getHeight()};
+	if(_list.size() == 1 && SDL_RectEquals(&_list[0], &whole)) { return; }
+	if(_list.size() + _regions.size() > MAX_FRAME_REGIONS)
+	{
+		_list.assign(1, whole);
+		return;
+	}
+	_list.insert(_list.end(), _regions.begin(), _regions.end());
+}
\ No newline at end of file
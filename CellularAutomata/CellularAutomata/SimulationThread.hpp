@@ -0,0 +1,88 @@
+#pragma once
+
+#include "SDL.h"
+#include "Simulation.hpp"
+#include "Recorder.hpp"
+#include "World.hpp"
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+const Uint8 FRAME_BUFFERS = 3;
+const Uint16 MAX_FRAME_REGIONS = 256;
+
+//Runs a simulation on its own thread at a fixed tick rate, so that a slow tick never stalls input or rendering.
+//Input reaches the simulation through a command queue that is applied at the start of each tick.
+//Every tick's changed cells are copied into one of three frame buffers, and the renderer picks up the newest finished one
+//and expands its cells straight into the locked texture, so no pixels are drawn anywhere else first
+class SimulationThread
+{
+public:
+	enum class CommandType : Uint8
+	{
+		STROKE = 0,
+		RESET,
+		SCROLL,
+		SAVE,
+		LOAD
+	};
+
+	//A stroke draws a line of a material with a brush. A scroll moves the world by the start point
+	struct Command
+	{
+		CommandType type;
+		Simulation::Material material;
+		Uint16 radius;
+		SDL_Point start, end;
+		Simulation::Brush brush;
+	};
+
+	//The cells of a whole frame and the regions that changed since the last frame the renderer picked up
+	struct Frame
+	{
+		Simulation::Cell *cells;
+		std::vector<SDL_Rect> regions;
+	};
+
+	SimulationThread(Simulation *_sim, World *_world, Recorder *_recorder, Uint32 _tickInterval, const std::string &_snapshotPath);
+	~SimulationThread();
+
+	void pushCommand(const Command &_command);
+	const Frame *acquireFrame();
+
+	void setPaused(bool _paused) { paused = _paused; };
+	bool isPaused() const { return paused; };
+	Uint32 getTicksPerSecond() const { return ticksPerSecond; };
+
+private:
+	Simulation *sim;
+	World *world;
+	Recorder *recorder;
+	Uint32 tickInterval;
+	std::string snapshotPath;
+
+	std::thread thread;
+	std::mutex commandMutex;
+	std::condition_variable commandQueued;
+	std::vector<Command> commands;
+	std::atomic<bool> paused;
+	std::atomic<bool> stopping;
+	std::atomic<Uint32> ticksPerSecond;
+
+	//The simulation thread copies into the back frame and swaps it with the ready one. The renderer swaps the ready frame
+	//with the front one. Each frame keeps the regions it has missed since it was last copied into
+	std::mutex frameMutex;
+	Frame frames[FRAME_BUFFERS];
+	std::vector<SDL_Rect> pendingRegions[FRAME_BUFFERS];
+	Uint8 backFrame, readyFrame, frontFrame;
+	bool readyFresh;
+
+	void run();
+	void applyCommands();
+	void publishFrame();
+	void addRegions(std::vector<SDL_Rect> &_list, const std::vector<SDL_Rect> &_regions) const;
+};
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "Snapshot.hpp"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//A 52 byte little endian header is followed by 8 bytes per chunk rect, 4 bytes per heat block including its border,
+//3 bytes per material run and 1 byte per shade
+const Uint8 HEADER_SIZE = 52;
+const Uint8 RECT_SIZE = 8;
+const Uint8 RUN_SIZE = 3;
+const Uint16 MAX_RUN_LENGTH = 65535;
+
+//Hashes the names of the loaded materials in order, so that a material file that was reordered or renamed is noticed
+//even when it has as many materials as before
+Uint64 hashMaterials(const Simulation *_sim)
+{
+	Uint64 hash = 14695981039346656037ULL;
+	for(char c : _sim->getMaterialString()) { hash = (hash ^ static_cast<Uint8>(c)) * 1099511628211ULL; }
+	return hash;
+}
+
+Snapshot::Snapshot()
+{
+	data = nullptr;
+	dataSize = 0;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#else
+	fileHandle = -1;
+#endif
+	width = 0;
+	height = 0;
+	seed = 0;
+	tick = 0;
+	runCount = 0;
+	shadeCount = 0;
+}
+
+Snapshot::~Snapshot()
+{
+	close();
+}
+
+bool Snapshot::save(const std::string &_path, const Simulation *_sim)
+{
+	std::vector<Uint8> runs;
+	std::vector<Uint8> shades;
+	Uint32 count = 0;
+	Simulation::Material current = Simulation::Material::NO_MATERIAL;
+	Uint16 length = 0;
+	auto endRun = [&]()
+	{
+		if(length == 0) { return; }
+		runs.push_back(static_cast<Uint8>(current));
+		runs.push_back(length & 0xFF);
+		runs.push_back(length >> 8);
+		++count;
+	};
+	for(Sint32 y = 0; y < _sim->height; ++y)
+	{
+		for(Sint32 x = 0; x < _sim->width; ++x)
+		{
+			const Simulation::Cell &cell = _sim->computeBuffer[_sim->getIndex(x, y)];
+			if(cell.material != current || length == MAX_RUN_LENGTH)
+			{
+				endRun();
+				current = cell.material;
+				length = 0;
+			}
+			++length;
+			if(cell.material != Simulation::Material::EMPTY) { shades.push_back(cell.shade); }
+		}
+	}
+	endRun();
+
+	Uint8 header[HEADER_SIZE];
+	Uint32 shadeTotal = static_cast<Uint32>(shades.size());
+	Uint8 materialCount = _sim->materialCount;
+	Uint8 traversal = static_cast<Uint8>(_sim->traversal);
+	memcpy(header, &SNAPSHOT_MAGIC, sizeof(Uint32));
+	memcpy(header + 4, &SNAPSHOT_VERSION, sizeof(Uint16));
+	memcpy(header + 6, &_sim->width, sizeof(Uint16));
+	memcpy(header + 8, &_sim->height, sizeof(Uint16));
+	header[10] = materialCount;
+	header[11] = traversal;
+	memcpy(header + 12, &_sim->seed, sizeof(Uint32));
+	memcpy(header + 16, &_sim->tick, sizeof(Uint32));
+	memcpy(header + 20, &_sim->mainRng, sizeof(Simulation::Xorshift128));
+	memcpy(header + 36, &count, sizeof(Uint32));
+	memcpy(header + 40, &shadeTotal, sizeof(Uint32));
+	Uint64 materialHash = hashMaterials(_sim);
+	memcpy(header + 44, &materialHash, sizeof(Uint64));
+
+	std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+	if(!file.is_open()) { return false; }
+	file.write(reinterpret_cast<const char *>(header), HEADER_SIZE);
+	file.write(reinterpret_cast<const char *>(_sim->nextRects), _sim->chunkCount * RECT_SIZE);
+	file.write(reinterpret_cast<const char *>(_sim->heat), _sim->heatWide * _sim->heatHigh * sizeof(float));
+	file.write(reinterpret_cast<const char *>(runs.data()), runs.size());
+	file.write(reinterpret_cast<const char *>(shades.data()), shades.size());
+	return file.good();
+}
+
+//Maps the file and reads its header. The cells are only decoded by restore
+bool Snapshot::open(const std::string &_path)
+{
+	close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(fileHandle == INVALID_HANDLE_VALUE) { return false; }
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < HEADER_SIZE)
+	{
+		close();
+		return false;
+	}
+	dataSize = fileSize.QuadPart;
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mappingHandle) { data = static_cast<const Uint8 *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0)); }
+#else
+	fileHandle = ::open(_path.c_str(), O_RDONLY);
+	if(fileHandle < 0) { return false; }
+	struct stat info;
+	if(fstat(fileHandle, &info) != 0 || info.st_size < HEADER_SIZE)
+	{
+		close();
+		return false;
+	}
+	dataSize = info.st_size;
+	void *mapped = mmap(nullptr, dataSize, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+	if(mapped != MAP_FAILED)
+	{
+		madvise(mapped, dataSize, MADV_SEQUENTIAL);
+		data = static_cast<const Uint8 *>(mapped);
+	}
+#endif
+	if(!data)
+	{
+		close();
+		return false;
+	}
+
+	Uint32 magic;
+	Uint16 version;
+	memcpy(&magic, data, sizeof(Uint32));
+	memcpy(&version, data + 4, sizeof(Uint16));
+	memcpy(&width, data + 6, sizeof(Uint16));
+	memcpy(&height, data + 8, sizeof(Uint16));
+	memcpy(&seed, data + 12, sizeof(Uint32));
+	memcpy(&tick, data + 16, sizeof(Uint32));
+	memcpy(&runCount, data + 36, sizeof(Uint32));
+	memcpy(&shadeCount, data + 40, sizeof(Uint32));
+	if(magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+//Decodes the mapped file into a simulation of the same size. The whole file is checked before any cell is written,
+//so a truncated or corrupt snapshot leaves the simulation untouched
+bool Snapshot::restore(Simulation *_sim) const
+{
+	if(!data || _sim->width != width || _sim->height != height || data[10] != _sim->materialCount) { return false; }
+	Uint64 materialHash;
+	memcpy(&materialHash, data + 44, sizeof(Uint64));
+	if(materialHash != hashMaterials(_sim) || data[11] > static_cast<Uint8>(Simulation::Traversal::SWEEP)) { return false; }
+	Uint64 rectBytes = static_cast<Uint64>(_sim->chunkCount) * RECT_SIZE;
+	Uint64 heatBytes = static_cast<Uint64>(_sim->heatWide) * _sim->heatHigh * sizeof(float);
+	if(dataSize != HEADER_SIZE + rectBytes + heatBytes + static_cast<Uint64>(runCount) * RUN_SIZE + shadeCount) { return false; }
+
+	const Uint8 *runs = data + HEADER_SIZE + rectBytes + heatBytes;
+	const Uint8 *shades = runs + static_cast<Uint64>(runCount) * RUN_SIZE;
+	Uint64 cellTotal = 0;
+	Uint64 shadeTotal = 0;
+	for(Uint32 i = 0; i < runCount; ++i)
+	{
+		const Uint8 *run = runs + i * RUN_SIZE;
+		Uint16 length = run[1] | run[2] << 8;
+		if(run[0] >= _sim->materialCount) { return false; }
+		cellTotal += length;
+		if(run[0] != static_cast<Uint8>(Simulation::Material::EMPTY)) { shadeTotal += length; }
+	}
+	if(cellTotal != static_cast<Uint64>(width) * height || shadeTotal != shadeCount) { return false; }
+
+	_sim->setSeed(seed);
+	_sim->tick = tick;
+	_sim->traversal = static_cast<Simulation::Traversal>(data[11]);
+	memcpy(&_sim->mainRng, data + 20, sizeof(Simulation::Xorshift128));
+	memcpy(_sim->nextRects, data + HEADER_SIZE, rectBytes);
+	memcpy(_sim->heat, data + HEADER_SIZE + rectBytes, heatBytes);
+	for(Uint32 i = 0; i < _sim->chunkCount; ++i)
+	{
+		_sim->renderRects[i] = {0, 0, CHUNK_SIZE - 1, CHUNK_SIZE - 1};
+		_sim->heatStale[i] = true;
+	}
+
+	Sint32 x = 0;
+	Sint32 y = 0;
+	for(Uint32 i = 0; i < runCount; ++i)
+	{
+		const Uint8 *run = runs + i * RUN_SIZE;
+		Simulation::Material material = static_cast<Simulation::Material>(run[0]);
+		bool empty = material == Simulation::Material::EMPTY;
+		for(Uint16 length = run[1] | run[2] << 8; length > 0; --length)
+		{
+			_sim->computeBuffer[_sim->getIndex(x, y)] = {material, empty ? static_cast<Uint8>(0) : *shades++, _sim->generation};
+			if(++x == width)
+			{
+				x = 0;
+				++y;
+			}
+		}
+	}
+	return true;
+}
+
+void Snapshot::close()
+{
+#ifdef _WIN32
+	if(data) { UnmapViewOfFile(data); }
+	if(mappingHandle) { CloseHandle(mappingHandle); }
+	if(fileHandle != INVALID_HANDLE_VALUE) { CloseHandle(fileHandle); }
+	mappingHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if(data) { munmap(const_cast<Uint8 *>(data), dataSize); }
+	if(fileHandle >= 0) { ::close(fileHandle); }
+	fileHandle = -1;
+#endif
+	data = nullptr;
+	dataSize = 0;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "SDL.h"
+#include "Simulation.hpp"
+
+#include <string>
+
+const Uint32 SNAPSHOT_MAGIC = 0x504E5346; //"FSNP"
+const Uint16 SNAPSHOT_VERSION = 4;
+
+//Saves and restores the whole state of a simulation. Materials are run length encoded, followed by one shade per
+//non-empty cell, the sleep state of every chunk, the heat field and the random number state, so a restored world
+//continues exactly as the saved one would have. Files are memory mapped when opened and decoded straight into the simulation.
+//Cells store material numbers, so a snapshot is only restored by a simulation that loaded the same materials in the same order
+class Snapshot
+{
+public:
+	Snapshot();
+	~Snapshot();
+
+	static bool save(const std::string &_path, const Simulation *_sim);
+
+	bool open(const std::string &_path);
+	bool restore(Simulation *_sim) const;
+	void close();
+
+	Uint16 getWidth() const { return width; };
+	Uint16 getHeight() const { return height; };
+	Uint32 getSeed() const { return seed; };
+	Uint32 getTick() const { return tick; };
+
+private:
+	const Uint8 *data;
+	Uint64 dataSize;
+#ifdef _WIN32
+	void *fileHandle, *mappingHandle;
+#else
+	int fileHandle;
+#endif
+
+	Uint16 width, height;
+	Uint32 seed, tick;
+	Uint32 runCount, shadeCount;
+};
\ No newline at end of file
@@ -1,41 +1,44 @@
 #include "Texture.hpp"
+#include "GlyphAtlas.hpp"
 
 #include <algorithm>
 
-Texture::Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect)
+Texture::Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, Uint8 _scale)
 {
 	ren = _ren;
-	font = nullptr;
+	atlas = nullptr;
 	rect = _rect;
-	tex = SDL_CreateTexture(ren, PIXEL_FORMAT, SDL_TEXTUREACCESS_STREAMING, rect.w, rect.h);
+	tex = SDL_CreateTexture(ren, PIXEL_FORMAT, SDL_TEXTUREACCESS_STREAMING, rect.w / _scale, rect.h / _scale);
 	_success = _success && tex;
 	buttons = nullptr;
+	labels = nullptr;
 	buttonCount = 0;
 }
 
-Texture::Texture(SDL_Renderer *_ren, Sint32 _x, Sint32 _y, TTF_Font *_font)
+Texture::Texture(SDL_Renderer *_ren, Sint32 _x, Sint32 _y, const GlyphAtlas *_atlas)
 {
 	ren = _ren;
-	font = _font;
-	rect.x = _x;
-	rect.y = _y;
+	atlas = _atlas;
+	rect = {_x, _y, 0, 0};
 	tex = nullptr;
 	buttons = nullptr;
+	labels = nullptr;
 	buttonCount = 0;
 }
 
-Texture::Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, TTF_Font *_font, std::string _text)
+Texture::Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, const GlyphAtlas *_atlas, std::string _text)
 {
 	ren = _ren;
-	font = _font;
+	atlas = _atlas;
 	rect = _rect;
+	tex = nullptr;
 	
 	buttonCount = 0;
 	for(int i = 0; i < _text.size(); ++i) { if(_text[i] == ' ') { ++buttonCount; } }
 	buttons = new SDL_Rect[buttonCount];
+	labels = new std::string[buttonCount];
 
-	int textHeight;
-	TTF_SizeText(font, "A", nullptr, &textHeight);
+	int textHeight = atlas->getLineHeight();
 	Uint32 buttonHSpace = rect.w;
 	Uint32 buttonHMargin = buttonHSpace * BUTTON_MARGIN;
 	Uint32 buttonVSpace = textHeight * (buttonCount / BUTTONS_IN_ROW);
@@ -50,31 +53,21 @@ Texture::Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, TTF_Font *_
 		buttons[i].h = buttonHeight;
 	}
 	
-	SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0, rect.w, buttonVSpace, 32, PIXEL_FORMAT);
 	for(int i = 0; i < buttonCount; ++i)
 	{
 		Uint64 delimiterPos = _text.find_first_of(" ");
-		std::string text = _text.substr(0, delimiterPos);
+		labels[i] = _text.substr(0, delimiterPos);
 		_text = _text.substr(delimiterPos + 1);
-		SDL_Surface *tempSurf = TTF_RenderText_Solid(font, text.c_str(), TEXT_COLOR);
-		int textWidth;
-		TTF_SizeText(font, text.c_str(), &textWidth, nullptr);
-		SDL_Rect tempRect = {buttons[i].x - rect.x + buttonWidth / 2 - textWidth / 2, buttons[i].y - rect.y, 0, 0};
-		SDL_BlitSurface(tempSurf, nullptr, surf, &tempRect);
-		SDL_FreeSurface(tempSurf);
-		
 	}
-	tex = SDL_CreateTextureFromSurface(ren, surf);
-	SDL_FreeSurface(surf);
-	_success = _success && tex;
-	if(!_success) { return; }
-	SDL_QueryTexture(tex, nullptr, nullptr, &rect.w, &rect.h);
+	rect.h = buttonVSpace;
+	_success = _success && atlas;
 }
 
 Texture::~Texture()
 {
 	if(tex) { SDL_DestroyTexture(tex); }
 	if(buttons) { delete[] buttons; }
+	if(labels) { delete[] labels; }
 }
 
 bool Texture::isButtonClicked(const SDL_Point *_pos, Uint8 &_button) const
@@ -93,22 +86,39 @@ bool Texture::isButtonClicked(const SDL_Point *_pos, Uint8 &_button) const
 void Texture::renderTexture()
 {
 	if(tex) { SDL_RenderCopy(ren, tex, nullptr, &rect); }
+	if(!atlas) { return; }
+	if(!buttons)
+	{
+		atlas->drawText(text, rect.x, rect.y);
+		return;
+	}
+	//Each label is centered at the top of its button
+	for(int i = 0; i < buttonCount; ++i)
+	{
+		Sint32 labelWidth, labelHeight;
+		atlas->measureText(labels[i], labelWidth, labelHeight);
+		atlas->drawText(labels[i], buttons[i].x + buttons[i].w / 2 - labelWidth / 2, buttons[i].y);
+	}
+}
+
+//Gives direct access to an area of a streaming texture's pixels, so that it can be written without an extra copy.
+//The locked memory is write only, so every pixel of the area has to be written
+bool Texture::lockTexture(const SDL_Rect *_area, Uint32 *&_pixels, int &_pitch)
+{
+	void *pixels;
+	if(SDL_LockTexture(tex, _area, &pixels, &_pitch) != 0) { return false; }
+	_pixels = static_cast<Uint32 *>(pixels);
+	return true;
 }
 
-void Texture::changeTexture(Uint32 *_buffer, Uint32 _size)
+void Texture::unlockTexture()
 {
-	SDL_UpdateTexture(tex, nullptr, _buffer, _size * sizeof(Uint32));
+	SDL_UnlockTexture(tex);
 }
 
+//Only stores the text, so it is cheap enough to call on every frame. Newlines start another line
 void Texture::changeText(std::string _text)
 {
-	SDL_Surface *surf = TTF_RenderText_Solid(font, _text.c_str(), TEXT_COLOR);
-	SDL_Texture *tempTex = SDL_CreateTextureFromSurface(ren, surf);
-	SDL_FreeSurface(surf);
-	if(tempTex)
-	{
-		if(tex) { SDL_DestroyTexture(tex); }
-		tex = tempTex;
-		SDL_QueryTexture(tex, nullptr, nullptr, &rect.w, &rect.h);
-	}
+	text = _text;
+	atlas->measureText(text, rect.w, rect.h);
 }
\ No newline at end of file
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "SDL.h"
-#include "SDL_ttf.h"
 
 #include <string>
 
@@ -12,28 +11,34 @@ const float BUTTON_MARGIN = 0.05f;
 
 const SDL_Color TEXT_COLOR = {255, 255, 255, 255};
 
+class GlyphAtlas;
+
+//Text and button labels are drawn from a shared glyph atlas on every render, so they own no texture of their own
 class Texture
 {
 public:
-	//Normal texture
-	Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect);
+	//Normal texture. Every texel is stretched over a square of _scale by _scale pixels of the rect
+	Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, Uint8 _scale = 1);
 	//Nonstatic text texture
-	Texture(SDL_Renderer *_ren, Sint32 _x, Sint32 _y, TTF_Font *_font);
+	Texture(SDL_Renderer *_ren, Sint32 _x, Sint32 _y, const GlyphAtlas *_atlas);
 	//Button texture
-	Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, TTF_Font *_font, std::string _text);
+	Texture(SDL_Renderer *_ren, bool &_success, SDL_Rect _rect, const GlyphAtlas *_atlas, std::string _text);
 	~Texture();
 
 	bool isButtonClicked(const SDL_Point *_pos, Uint8 &_button) const;
 
 	void renderTexture();
-	void changeTexture(Uint32 *_buffer, Uint32 _size);
+	bool lockTexture(const SDL_Rect *_area, Uint32 *&_pixels, int &_pitch);
+	void unlockTexture();
 	void changeText(std::string _text);
 
 private:
 	SDL_Renderer *ren;
 	SDL_Texture *tex;
-	TTF_Font *font;
+	const GlyphAtlas *atlas;
+	std::string text;
 	SDL_Rect rect;
 	SDL_Rect *buttons;
+	std::string *labels;
 	Uint8 buttonCount;
 };
\ No newline at end of file
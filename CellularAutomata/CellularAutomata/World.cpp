@@ -0,0 +1,203 @@
+#include "World.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstdio>
+
+World::World(Simulation *_sim, Uint16 _regionsWide, Uint16 _regionsHigh, const std::string &_directory)
+{
+	sim = _sim;
+	regionsWide = _regionsWide;
+	regionsHigh = _regionsHigh;
+	directory = _directory;
+	std::filesystem::create_directories(directory);
+
+	regions = new Region[regionsWide * regionsHigh];
+	for(int i = 0; i < regionsWide * regionsHigh; ++i) { regions[i] = {RegionState::UNTOUCHED, nullptr, 0}; }
+	residentCount = 0;
+	useCounter = 0;
+	origin = {0, 0};
+
+	stopping = false;
+	loader = std::thread(&World::loaderLoop, this);
+
+	copyWindow(false);
+	prefetch();
+}
+
+//Region files only live as long as the world that wrote them
+World::~World()
+{
+	{
+		std::lock_guard<std::mutex> lock(regionMutex);
+		stopping = true;
+	}
+	loadQueued.notify_all();
+	loader.join();
+
+	for(int i = 0; i < regionsWide * regionsHigh; ++i)
+	{
+		if(regions[i].state != RegionState::UNTOUCHED) { std::remove(getRegionPath(i).c_str()); }
+		delete[] regions[i].cells;
+	}
+	delete[] regions;
+}
+
+//Moves the window over the map. The window's cells are stored back into their regions, and the cells at the new position
+//are loaded into the simulation. Regions that were not prefetched in time are loaded on the spot
+void World::scroll(Sint32 _dx, Sint32 _dy)
+{
+	SDL_Point next = {std::clamp<Sint32>(origin.x + _dx, 0, getWidth() - sim->getWidth()),
+		std::clamp<Sint32>(origin.y + _dy, 0, getHeight() - sim->getHeight())};
+	if(next.x == origin.x && next.y == origin.y) { return; }
+
+	copyWindow(true);
+	origin = next;
+	copyWindow(false);
+	prefetch();
+	evict();
+}
+
+void World::loaderLoop()
+{
+	while(true)
+	{
+		Uint32 region;
+		{
+			std::unique_lock<std::mutex> lock(regionMutex);
+			loadQueued.wait(lock, [&] { return stopping || !loadQueue.empty(); });
+			if(stopping) { return; }
+			region = loadQueue.front();
+			loadQueue.erase(loadQueue.begin());
+		}
+
+		Simulation::Cell *cells = new Simulation::Cell[REGION_SIZE * REGION_SIZE];
+		if(!readRegion(region, cells)) { std::fill(cells, cells + REGION_SIZE * REGION_SIZE, Simulation::Cell{Simulation::Material::EMPTY, 0, 0}); }
+		{
+			std::lock_guard<std::mutex> lock(regionMutex);
+			regions[region] = {RegionState::RESIDENT, cells, ++useCounter};
+			++residentCount;
+		}
+		loadFinished.notify_all();
+	}
+}
+
+std::string World::getRegionPath(Uint32 _region) const
+{
+	return directory + "/region_" + std::to_string(_region) + ".bin";
+}
+
+bool World::readRegion(Uint32 _region, Simulation::Cell *_cells) const
+{
+	std::ifstream file(getRegionPath(_region), std::ios::binary);
+	file.read(reinterpret_cast<char *>(_cells), REGION_SIZE * REGION_SIZE * sizeof(Simulation::Cell));
+	return file.good();
+}
+
+bool World::writeRegion(Uint32 _region, const Simulation::Cell *_cells) const
+{
+	std::ofstream file(getRegionPath(_region), std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(_cells), REGION_SIZE * REGION_SIZE * sizeof(Simulation::Cell));
+	return file.good();
+}
+
+//Copies between the simulation and every region the window overlaps, one intersecting rect at a time
+void World::copyWindow(bool _store)
+{
+	Sint32 right = origin.x + sim->getWidth();
+	Sint32 bottom = origin.y + sim->getHeight();
+	for(Sint32 ry = origin.y / REGION_SIZE; ry <= (bottom - 1) / REGION_SIZE; ++ry)
+	{
+		for(Sint32 rx = origin.x / REGION_SIZE; rx <= (right - 1) / REGION_SIZE; ++rx)
+		{
+			Simulation::Cell *cells = acquireRegion(ry * regionsWide + rx);
+			Sint32 minX = std::max(origin.x, rx * REGION_SIZE);
+			Sint32 minY = std::max(origin.y, ry * REGION_SIZE);
+			Sint32 maxX = std::min(right, (rx + 1) * REGION_SIZE);
+			Sint32 maxY = std::min(bottom, (ry + 1) * REGION_SIZE);
+			SDL_Rect area = {minX - origin.x, minY - origin.y, maxX - minX, maxY - minY};
+			Simulation::Cell *start = cells + (minY - ry * REGION_SIZE) * REGION_SIZE + minX - rx * REGION_SIZE;
+			if(_store) { sim->readCells(&area, start, REGION_SIZE); }
+			else { sim->writeCells(&area, start, REGION_SIZE); }
+		}
+	}
+}
+
+//Makes a region resident and marks it as used. A region still waiting in the queue is loaded here instead,
+//while one the loader is already reading is waited for
+Simulation::Cell *World::acquireRegion(Uint32 _region)
+{
+	std::unique_lock<std::mutex> lock(regionMutex);
+	Region &region = regions[_region];
+	if(region.state == RegionState::LOADING)
+	{
+		auto queued = std::find(loadQueue.begin(), loadQueue.end(), _region);
+		if(queued != loadQueue.end())
+		{
+			loadQueue.erase(queued);
+			region.state = RegionState::ON_DISK;
+		}
+		else { loadFinished.wait(lock, [&] { return region.state != RegionState::LOADING; }); }
+	}
+	if(region.state != RegionState::RESIDENT)
+	{
+		region.cells = new Simulation::Cell[REGION_SIZE * REGION_SIZE];
+		if(region.state == RegionState::UNTOUCHED || !readRegion(_region, region.cells))
+		{
+			std::fill(region.cells, region.cells + REGION_SIZE * REGION_SIZE, Simulation::Cell{Simulation::Material::EMPTY, 0, 0});
+		}
+		region.state = RegionState::RESIDENT;
+		++residentCount;
+	}
+	region.lastUsed = ++useCounter;
+	return region.cells;
+}
+
+//Queues every paged out region close to the window
+void World::prefetch()
+{
+	{
+		std::lock_guard<std::mutex> lock(regionMutex);
+		for(Uint32 i = 0; i < regionsWide * regionsHigh; ++i)
+		{
+			if(regions[i].state != RegionState::ON_DISK || !isNearWindow(i, PREFETCH_MARGIN)) { continue; }
+			regions[i].state = RegionState::LOADING;
+			loadQueue.push_back(i);
+		}
+	}
+	loadQueued.notify_one();
+}
+
+//Pages out the least recently used regions until few enough are resident. Regions close to the window are never paged out
+void World::evict()
+{
+	std::lock_guard<std::mutex> lock(regionMutex);
+	while(residentCount > MAX_RESIDENT_REGIONS)
+	{
+		Sint64 oldest = -1;
+		for(Uint32 i = 0; i < regionsWide * regionsHigh; ++i)
+		{
+			if(regions[i].state != RegionState::RESIDENT || isNearWindow(i, PREFETCH_MARGIN)) { continue; }
+			if(oldest < 0 || regions[i].lastUsed < regions[oldest].lastUsed) { oldest = i; }
+		}
+		if(oldest < 0 || !writeRegion(oldest, regions[oldest].cells)) { return; }
+
+		delete[] regions[oldest].cells;
+		regions[oldest].cells = nullptr;
+		regions[oldest].state = RegionState::ON_DISK;
+		--residentCount;
+	}
+}
+
+//Whether a region overlaps the window grown by a number of regions on every side
+bool World::isNearWindow(Uint32 _region, Uint8 _margin) const
+{
+	Sint32 rx = _region % regionsWide;
+	Sint32 ry = _region / regionsWide;
+	Sint32 minX = origin.x / REGION_SIZE - _margin;
+	Sint32 minY = origin.y / REGION_SIZE - _margin;
+	Sint32 maxX = (origin.x + sim->getWidth() - 1) / REGION_SIZE + _margin;
+	Sint32 maxY = (origin.y + sim->getHeight() - 1) / REGION_SIZE + _margin;
+	return rx >= minX && rx <= maxX && ry >= minY && ry <= maxY;
+}
\ No newline at end of file
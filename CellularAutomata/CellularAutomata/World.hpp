@@ -0,0 +1,77 @@
+#pragma once
+
+#include "SDL.h"
+#include "Simulation.hpp"
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+const Uint16 REGION_SIZE = 256;
+const Uint16 MAX_RESIDENT_REGIONS = 64;
+const Uint8 PREFETCH_MARGIN = 1;
+
+//A map much larger than the simulation, split into square regions. The simulation is a window onto the map
+//that is the only part being simulated. Regions outside the window do not update, even while they are resident,
+//and pick up where they left off once they are scrolled back in. Scrolling stores the window back into its regions and loads the new one.
+//Only the least recently used regions far from the window are paged out to files in a directory, and
+//regions next to the window are loaded back in on a background thread before they scroll into view
+class World
+{
+public:
+	World(Simulation *_sim, Uint16 _regionsWide, Uint16 _regionsHigh, const std::string &_directory);
+	~World();
+
+	void scroll(Sint32 _dx, Sint32 _dy);
+
+	Uint32 getWidth() const { return regionsWide * REGION_SIZE; };
+	Uint32 getHeight() const { return regionsHigh * REGION_SIZE; };
+	SDL_Point getOrigin() const { return origin; };
+	Uint32 getResidentCount() const { return residentCount; };
+
+private:
+	//A region that was never touched holds no memory and reads as empty
+	enum class RegionState : Uint8
+	{
+		UNTOUCHED = 0,
+		RESIDENT,
+		LOADING,
+		ON_DISK
+	};
+
+	struct Region
+	{
+		RegionState state;
+		Simulation::Cell *cells;
+		Uint64 lastUsed;
+	};
+
+	Simulation *sim;
+	Uint16 regionsWide, regionsHigh;
+	std::string directory;
+	Region *regions;
+	std::atomic<Uint32> residentCount;
+	Uint64 useCounter;
+	SDL_Point origin;
+
+	//Loads are handed to a single background thread through a queue. Region states are only changed while holding the lock
+	std::thread loader;
+	std::mutex regionMutex;
+	std::condition_variable loadQueued, loadFinished;
+	std::vector<Uint32> loadQueue;
+	bool stopping;
+
+	void loaderLoop();
+	std::string getRegionPath(Uint32 _region) const;
+	bool readRegion(Uint32 _region, Simulation::Cell *_cells) const;
+	bool writeRegion(Uint32 _region, const Simulation::Cell *_cells) const;
+
+	void copyWindow(bool _store);
+	Simulation::Cell *acquireRegion(Uint32 _region);
+	void prefetch();
+	void evict();
+	bool isNearWindow(Uint32 _region, Uint8 _margin) const;
+};
\ No newline at end of file